@@ -34,10 +34,18 @@ namespace ircd::allocator::je
 #include "callback.h"
 #include "dynamic.h"
 #include "fixed.h"
+#include "concurrent.h"
 #include "scope.h"
 #include "node.h"
 #include "profile.h"
+#include "attribution.h"
+#include "sampler.h"
 #include "twolevel.h"
+#include "slab.h"
+#include "arena.h"
+#include "hugepage.h"
+#include "je.h"
+#include "pressure.h"
 
 namespace ircd
 {
@@ -0,0 +1,157 @@
+#pragma once
+#define HAVE_IRCD_ALLOCATOR_ARENA_H
+
+namespace ircd::allocator
+{
+	struct arena;
+}
+
+/// Monotonic (bump) allocator which frees everything at once.
+///
+/// Allocations are carved from the front of the current block; nothing is
+/// freed individually. Space starts with the optional initial buffer given
+/// by the user (i.e. on the stack or a fixed_buffer) and continues with
+/// blocks from the heap, each twice the size of the last up to block_max.
+/// The heap blocks are freed on destruction, or by rewinding to a mark taken
+/// earlier. Suited to the objects created while handling one request.
+///
+/// The arena::allocator template is the std:: allocator for containers and
+/// an arena::scope directs the allocations made with new on this thread
+/// into the arena while it exists.
+struct ircd::allocator::arena
+{
+	struct block;
+	struct mark;
+	struct scope;
+	template<class T> struct allocator;
+
+	static constexpr size_t block_max {1UL << 20};
+
+	mutable_buffer initial;                      // User's space (not freed)
+	block *head {nullptr};                       // Newest heap block
+	block **table {nullptr};                     // Heap blocks by index
+	size_t table_size {0};                       // Capacity of the table
+	char *pos {nullptr};                         // Next free byte
+	char *end {nullptr};                         // End of the current block
+	size_t block_size;                           // Of the next heap block
+	size_t allocated {0};                        // Bytes given out
+	size_t blocks {0};                           // Heap blocks held
+
+  private:
+	char *grow(const size_t &size, const size_t &align);
+
+  public:
+	bool owns(const void *) const noexcept;
+	size_t remaining() const noexcept;
+
+	[[gnu::malloc, gnu::returns_nonnull]]
+	void *allocate(const size_t &size, const size_t &align = alignof(std::max_align_t));
+
+	void rewind(const mark &) noexcept;
+	void reset() noexcept;
+
+	arena(const mutable_buffer &initial = {}, const size_t &block_size = 4096);
+	arena(arena &&) = delete;
+	arena(const arena &) = delete;
+	~arena() noexcept;
+};
+
+/// Position in the arena to rewind to; allocations made after it are freed.
+struct ircd::allocator::arena::mark
+{
+	block *head {nullptr};
+	char *pos {nullptr};
+	size_t allocated {0};
+
+	mark(const arena &a) noexcept
+	:head{a.head}
+	,pos{a.pos}
+	,allocated{a.allocated}
+	{}
+
+	mark() = default;
+};
+
+/// The std:: allocator; deallocate() does nothing.
+template<class T>
+struct ircd::allocator::arena::allocator
+{
+	using value_type = T;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+
+	arena *a;
+
+	template<class U> struct rebind
+	{
+		using other = typename arena::allocator<U>;
+	};
+
+	[[gnu::malloc, gnu::returns_nonnull]]
+	T *allocate(const size_type &n)
+	{
+		return static_cast<T *>(a->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T *const p, const size_type &n) noexcept
+	{
+		assert(a->owns(p));
+	}
+
+	template<class U>
+	bool operator==(const allocator<U> &o) const noexcept
+	{
+		return a == o.a;
+	}
+
+	template<class U>
+	bool operator!=(const allocator<U> &o) const noexcept
+	{
+		return a != o.a;
+	}
+
+	template<class U>
+	allocator(const allocator<U> &o) noexcept
+	:a{o.a}
+	{}
+
+	allocator(arena &a) noexcept
+	:a{&a}
+	{}
+};
+
+/// Serves the global operator new on this thread from the arena while it
+/// exists; operator delete of memory the arena owns does nothing and other
+/// frees are passed through. Each allocation is tagged with the index of its
+/// block so ownership is decided in constant time.
+///
+/// Objects made in the scope must be destroyed in it or left to the arena
+/// (i.e. by reset()). Nothing marks them once the scope has ended: delete
+/// after it hands the arena's memory to free(3) and corrupts the heap. Nor
+/// may they be deleted in a scope of another arena nested within this one.
+/// The scope must not span a context switch.
+///
+/// malloc(3) is only redirected through the allocator::scope hooks, which
+/// glibc 2.34 and later no longer calls; there, C code in the scope still
+/// allocates from the heap.
+struct ircd::allocator::arena::scope
+:ircd::allocator::scope
+{
+	struct tag;
+
+	static thread_local arena *current;
+	arena *outer;
+
+	static bool owns(const arena &, const void *) noexcept;
+	static void *allocate(arena &, const size_t &);
+
+	scope(arena &);
+	~scope() noexcept;
+};
+
+inline size_t
+ircd::allocator::arena::remaining()
+const noexcept
+{
+	return end - pos;
+}
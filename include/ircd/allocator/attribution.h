@@ -0,0 +1,56 @@
+#pragma once
+#define HAVE_IRCD_ALLOCATOR_ATTRIBUTION_H
+
+/// Allocation attribution.
+///
+/// When enabled at runtime, each allocation through global operator new or
+/// allocator::allocate() is counted against the name of the running context;
+/// or when on the main stack, against the descriptor of the running
+/// ios::handler. Anything else (i.e. other threads) is counted under the
+/// empty name. Counters persist after their contexts exit, so the result is
+/// the total for every context which had the same name. When disabled, the
+/// cost is a test of the enable flag in the allocation path.
+namespace ircd::allocator::attribution
+{
+	struct entry;
+
+	extern bool enable;
+	extern std::atomic<uint64_t> dropped;        // Charges without an entry
+
+	bool for_each(const std::function<bool (const entry &)> &);
+	entry *find(const string_view &name) noexcept;
+	entry *target() noexcept;
+	void charge(const size_t &size) noexcept;
+}
+
+/// Counters for one name; the table of these has a fixed size and entries
+/// are never removed.
+struct ircd::allocator::attribution::entry
+{
+	char name[32] {0};
+	std::atomic<uint64_t> count {0};
+	std::atomic<uint64_t> bytes {0};
+};
+
+[[gnu::always_inline]]
+inline void
+ircd::allocator::attribution::charge(const size_t &size)
+noexcept
+{
+	if(likely(!enable))
+		return;
+
+	auto *const entry
+	{
+		target()
+	};
+
+	if(unlikely(!entry))
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	entry->count.fetch_add(1, std::memory_order_relaxed);
+	entry->bytes.fetch_add(size, std::memory_order_relaxed);
+}
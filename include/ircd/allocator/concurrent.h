@@ -0,0 +1,174 @@
+#pragma once
+#define HAVE_IRCD_ALLOCATOR_CONCURRENT_H
+
+namespace ircd::allocator
+{
+	struct atomic_state;
+
+	template<class T = char,
+	         size_t = 512>
+	struct concurrent;
+}
+
+/// Bitmap state like allocator::state which any number of threads may
+/// allocate from and deallocate to at once.
+///
+/// Bits are claimed with fetch_or and released with fetch_and on the words;
+/// when a claim finds some of its bits were taken meanwhile, the bits it did
+/// set are released again and the search goes on. A run never crosses a
+/// word, so at most word_bits can be allocated at once. Each thread begins
+/// its search at the word it last allocated from, which spreads threads
+/// across the bitmap and away from each other's words. The cursor is only a
+/// hint and is shared by every instance the thread uses.
+struct ircd::allocator::atomic_state
+{
+	using word_t                                 = state::word_t;
+	using size_type                              = std::size_t;
+
+	static constexpr uint word_bits              { state::word_bits                                };
+
+	static thread_local uint cursor;             // Word a thread searches from
+
+	size_t size                                  { 0                                               };
+	std::atomic<word_t> *avail                   { nullptr                                         };
+
+	size_t words() const                         { return (size + word_bits - 1) / word_bits;      }
+	bool test(const uint &pos) const;
+
+  public:
+	size_t used() const;
+	void deallocate(const uint &p, const size_t &n) noexcept;
+	uint allocate(std::nothrow_t, const size_t &n);
+	uint allocate(const size_t &n);
+
+	atomic_state(const size_t &size = 0,
+	             std::atomic<word_t> *const &avail = nullptr)
+	:size{size}
+	,avail{avail}
+	{}
+};
+
+/// The fixed allocator for sharing between threads: i.e. objects allocated
+/// on the main loop and freed by ole workers, or the reverse, without
+/// malloc. Used like allocator::fixed; the instance must outlive the
+/// containers and can't be copied or moved.
+///
+template<class T,
+         size_t MAX>
+struct ircd::allocator::concurrent
+:atomic_state
+{
+	struct allocator;
+	using value = std::aligned_storage<sizeof(T), alignof(T)>;
+
+	std::array<std::atomic<word_t>, (MAX + word_bits - 1) / word_bits> avail {};
+	std::array<typename value::type, MAX> buf;
+
+  public:
+	bool in_range(const T *const &ptr) const
+	{
+		const auto base(reinterpret_cast<const T *>(buf.data()));
+		return ptr >= base && ptr < base + MAX;
+	}
+
+	allocator operator()();
+	operator allocator();
+
+	concurrent()
+	:atomic_state
+	{
+		MAX, avail.data()
+	}
+	{}
+};
+
+/// The allocator template as used by the container.
+template<class T,
+         size_t SIZE>
+struct ircd::allocator::concurrent<T, SIZE>::allocator
+{
+	using value_type         = T;
+	using pointer            = T *;
+	using const_pointer      = const T *;
+	using reference          = T &;
+	using const_reference    = const T &;
+	using size_type          = std::size_t;
+	using difference_type    = std::ptrdiff_t;
+
+	concurrent *s;
+
+  public:
+	template<class U> struct rebind
+	{
+		using other = typename concurrent<U, SIZE>::allocator;
+	};
+
+	size_type max_size() const
+	{
+		return std::min(SIZE, size_t(word_bits));
+	}
+
+	pointer
+	__attribute__((malloc, warn_unused_result))
+	allocate(std::nothrow_t, const size_type &n)
+	{
+		const auto base(reinterpret_cast<pointer>(s->buf.data()));
+		const auto pos(s->atomic_state::allocate(std::nothrow, n));
+		return pos < SIZE? base + pos : nullptr;
+	}
+
+	pointer
+	__attribute__((malloc, returns_nonnull, warn_unused_result))
+	allocate(const size_type &n, const const_pointer &hint = nullptr)
+	{
+		const auto base(reinterpret_cast<pointer>(s->buf.data()));
+		return base + s->atomic_state::allocate(n);
+	}
+
+	void deallocate(const pointer &p, const size_type &n) noexcept
+	{
+		const auto base(reinterpret_cast<pointer>(s->buf.data()));
+		s->atomic_state::deallocate(p - base, n);
+	}
+
+	template<class U,
+	         size_t OTHER_SIZE = SIZE>
+	allocator(const typename concurrent<U, OTHER_SIZE>::allocator &s) noexcept
+	:s{reinterpret_cast<concurrent<T, SIZE> *>(s.s)}
+	{
+		static_assert(OTHER_SIZE == SIZE);
+	}
+
+	allocator(concurrent &s) noexcept
+	:s{&s}
+	{}
+
+	allocator(allocator &&) = default;
+	allocator(const allocator &) = default;
+
+	friend bool operator==(const allocator &a, const allocator &b)
+	{
+		return a.s == b.s;
+	}
+
+	friend bool operator!=(const allocator &a, const allocator &b)
+	{
+		return a.s != b.s;
+	}
+};
+
+template<class T,
+         size_t SIZE>
+inline typename ircd::allocator::concurrent<T, SIZE>::allocator
+ircd::allocator::concurrent<T, SIZE>::operator()()
+{
+	return ircd::allocator::concurrent<T, SIZE>::allocator(*this);
+}
+
+template<class T,
+         size_t SIZE>
+inline ircd::allocator::concurrent<T, SIZE>::operator
+allocator()
+{
+	return ircd::allocator::concurrent<T, SIZE>::allocator(*this);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#define HAVE_IRCD_ALLOCATOR_HUGEPAGE_H
+
+/// Huge page arena for large long-lived buffers.
+///
+/// Memory is mapped in regions aligned to the huge page size and advised for
+/// transparent huge pages, or optionally backed by the reserved hugetlb pool
+/// with MAP_HUGETLB (falling back to THP when the pool is exhausted).
+/// Requests which are at least half a huge page once rounded to the page
+/// size get their own region, rounded up to a multiple of the huge page
+/// size. Smaller requests are carved into slots of their size (rounded to the
+/// page size) from shared regions; freed slots are
+/// kept for reuse by requests of the same size. Users must deallocate with
+/// the same buffer which was allocated.
+///
+/// Other allocations are not advised; allocator::allocate() only advises
+/// allocations aligned to the huge page size.
+namespace ircd::allocator::hugepage
+{
+	extern const size_t size;               // 0 if not supported
+	extern const bool thp;                  // Transparent huge pages available
+	extern bool hugetlb;                    // Back new regions with MAP_HUGETLB
+	extern std::atomic<size_t> requested;   // Bytes asked for by users now
+	extern std::atomic<size_t> padded;      // Bytes given out now (slot/region sizes)
+	extern std::atomic<size_t> mapped;      // Bytes mapped in regions
+
+	size_t backed();                        // Bytes of regions in huge pages
+
+	mutable_buffer allocate(const size_t &);
+	void deallocate(const mutable_buffer &) noexcept;
+}
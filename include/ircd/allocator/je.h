@@ -0,0 +1,137 @@
+#pragma once
+#define HAVE_IRCD_ALLOCATOR_JE_H
+
+/// Dedicated jemalloc arenas for subsystems.
+///
+/// Memory with different lifetimes (i.e. long-lived caches versus garbage
+/// from a request) fragments less when it does not share arenas, and each
+/// arena can be given its own decay times and purged on its own. Arenas are
+/// selected either for everything malloc'ed on a thread while an
+/// arena::scope exists, or for a container by its arena::allocator.
+///
+/// Without jemalloc the arenas exist but allocate from the default heap; the
+/// controls do nothing and the stats are zero.
+namespace ircd::allocator::je
+{
+	struct arena;
+
+	// Thread cache (tcache) controls for the calling thread.
+	bool tcache(const bool &enable);
+	void tcache_flush() noexcept;
+
+	// Purge all arenas; false without jemalloc.
+	bool purge() noexcept;
+
+	bool for_each(const std::function<bool (const arena &)> &);
+}
+
+struct ircd::allocator::je::arena
+{
+	struct scope;
+	struct stats;
+	template<class T> struct allocator;
+
+	static arena ctx_stack;                      // Context stacks
+	static arena io_buffer;                      // Socket and file buffers
+	static arena handler;                        // ios handlers and closures
+	static arena cache;                          // Long-lived caches
+
+	string_view name;
+	uint id {0};                                 // jemalloc arena index
+	ssize_t dirty_decay_ms;                      // -1 to never decay
+	ssize_t muzzy_decay_ms;                      // -1 to never decay
+	arena *next {nullptr};                       // Registry of all arenas
+
+  private:
+	bool create() noexcept;
+
+  public:
+	struct stats stats() const;
+	bool decay(const ssize_t &dirty_ms, const ssize_t &muzzy_ms) noexcept;
+	void purge() noexcept;
+
+	[[gnu::malloc, gnu::returns_nonnull]]
+	void *allocate(const size_t &size, const size_t &align = alignof(std::max_align_t));
+	void deallocate(void *, const size_t &size) noexcept;
+
+	arena(const string_view &name, const ssize_t &dirty_decay_ms = 10000, const ssize_t &muzzy_decay_ms = 10000);
+	arena(arena &&) = delete;
+	arena(const arena &) = delete;
+	~arena() noexcept;
+};
+
+/// Arena counters in bytes, as of the time stats() was called.
+struct ircd::allocator::je::arena::stats
+{
+	size_t allocated {0};                        // small + large allocated
+	size_t active {0};                           // In active pages
+	size_t dirty {0};                            // Unused dirty pages
+	size_t muzzy {0};                            // Unused muzzy pages
+	size_t mapped {0};
+	size_t resident {0};
+};
+
+/// Routes the thread's malloc(3) into the arena while this exists. The thread
+/// cache is flushed on entry and exit so objects cached from one arena are
+/// not handed out as the other's.
+struct ircd::allocator::je::arena::scope
+{
+	static thread_local scope *current;
+
+	scope *theirs;
+	uint their_id {0};
+
+  public:
+	scope(arena &);
+	scope(const scope &) = delete;
+	scope(scope &&) = delete;
+	~scope() noexcept;
+};
+
+/// std:: allocator from the arena.
+template<class T>
+struct ircd::allocator::je::arena::allocator
+{
+	using value_type = T;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+
+	je::arena *a;
+
+	template<class U> struct rebind
+	{
+		using other = typename arena::allocator<U>;
+	};
+
+	[[gnu::malloc, gnu::returns_nonnull]]
+	T *allocate(const size_type &n)
+	{
+		return static_cast<T *>(a->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T *const p, const size_type &n) noexcept
+	{
+		a->deallocate(p, n * sizeof(T));
+	}
+
+	template<class U>
+	bool operator==(const allocator<U> &o) const noexcept
+	{
+		return a == o.a;
+	}
+
+	template<class U>
+	bool operator!=(const allocator<U> &o) const noexcept
+	{
+		return a != o.a;
+	}
+
+	template<class U>
+	allocator(const allocator<U> &o) noexcept
+	:a{o.a}
+	{}
+
+	allocator(je::arena &a) noexcept
+	:a{&a}
+	{}
+};
@@ -0,0 +1,70 @@
+#pragma once
+#define HAVE_IRCD_ALLOCATOR_PRESSURE_H
+
+/// Memory pressure controller.
+///
+/// A background thread samples memory usage each interval: the cgroup's
+/// memory.current when running in one (v2, or usage_in_bytes for v1), or
+/// otherwise the RSS. Pressure begins when usage reaches the high ratio of
+/// the limit and ends only once it has fallen below the low ratio; between
+/// the two the previous state is kept, so the controller does not flap about
+/// a single mark. The limit is the cgroup's memory.high (or memory.max, or
+/// limit_in_bytes for v1) unless one is set here.
+///
+/// While under pressure each interval reclaims: the allocator purges its
+/// arenas (or trims, without jemalloc) and then the registered evictors are
+/// asked in turn for the bytes still over the low mark. Evictors are called
+/// on the controller's thread; those needing the event loop must post there.
+/// The settings may be changed while the controller runs.
+namespace ircd::allocator::pressure
+{
+	struct sample;
+	struct evictor;
+
+	extern std::atomic<size_t> limit;            // Bytes; 0 to use the cgroup's
+	extern std::atomic<float> high;              // Enter pressure at this of limit
+	extern std::atomic<float> low;               // Leave pressure under this of limit
+	extern std::atomic<std::chrono::milliseconds> interval;
+	extern std::atomic<bool> active;             // Under pressure now
+	extern std::atomic<uint64_t> episodes;       // Times pressure was entered
+	extern std::atomic<uint64_t> reclaims;       // Reclaim passes made
+
+	sample read();
+	size_t reclaim(const sample &) noexcept;
+	bool check() noexcept;
+
+	bool for_each(const std::function<bool (const evictor &)> &);
+	bool running() noexcept;
+	bool start();
+	void stop() noexcept;
+}
+
+/// Memory usage in bytes at one time; zero for what could not be read.
+struct ircd::allocator::pressure::sample
+{
+	size_t rss {0};
+	size_t cgroup_current {0};
+	size_t cgroup_limit {0};                     // memory.high or memory.max
+	size_t slack {0};                            // Reclaimable by the allocator
+	size_t usage {0};                            // What the marks apply to
+	size_t limit {0};                            // What the marks apply to
+};
+
+/// Registers a cache to be asked to evict under pressure. The function is
+/// given the bytes wanted and returns about what it freed.
+struct ircd::allocator::pressure::evictor
+{
+	using func = std::function<size_t (const size_t &want)>;
+
+	string_view name;
+	func function;
+	evictor *next {nullptr};                     // Registry of all evictors
+
+	std::atomic<uint64_t> calls {0};
+	std::atomic<uint64_t> evicted {0};           // Bytes reported freed
+
+	evictor(const string_view &name, func);
+	evictor(evictor &&) = delete;
+	evictor(const evictor &) = delete;
+	~evictor() noexcept;
+};
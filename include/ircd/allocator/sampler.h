@@ -0,0 +1,49 @@
+#pragma once
+#define HAVE_IRCD_ALLOCATOR_SAMPLER_H
+
+/// Sampling heap profiler.
+///
+/// When a rate is set, an allocation through global operator new is sampled
+/// about once every rate bytes: the intervals are drawn from an exponential
+/// distribution so allocations of every size are sampled in proportion to
+/// their bytes. A sample records the backtrace of the allocation and stays
+/// live until the memory is deleted. Otherwise the cost is a countdown on
+/// the allocating thread and a filter lookup when deleting.
+///
+/// A snapshot aggregates the live samples by backtrace. A snapshot can be
+/// limited to the samples taken since an earlier one (i.e. what was
+/// allocated after it and is still held: leaks), or two snapshots can be
+/// diffed for what grew between them. Snapshots are written in the legacy
+/// heap profile format read by pprof (heap_v2 with the sampling rate).
+namespace ircd::allocator::sampler
+{
+	struct site;
+	struct snapshot;
+
+	extern std::atomic<size_t> rate;             // Mean bytes between samples; 0 off
+	extern std::atomic<uint64_t> samples;        // Samples taken
+	extern std::atomic<uint64_t> live;           // Samples not yet freed
+
+	snapshot snap(const snapshot *since = nullptr);
+	snapshot diff(const snapshot &now, const snapshot &base);
+	std::ostream &dump(std::ostream &, const snapshot &);
+}
+
+/// Samples of one backtrace.
+struct ircd::allocator::sampler::site
+{
+	static constexpr size_t frames_max {32};
+
+	std::vector<void *> frames;
+	uint64_t count {0};                          // Live samples
+	uint64_t bytes {0};                          // Live sampled bytes
+	uint64_t total_count {0};                    // Samples ever
+	uint64_t total_bytes {0};                    // Sampled bytes ever
+};
+
+struct ircd::allocator::sampler::snapshot
+{
+	size_t rate {0};
+	uint64_t seq {0};                            // Samples taken before this
+	std::vector<site> sites;                     // Ordered by frames
+};
@@ -0,0 +1,173 @@
+#pragma once
+#define HAVE_IRCD_ALLOCATOR_SLAB_H
+
+namespace ircd::allocator
+{
+	struct slab_pool;
+	template<class T> struct slab;
+	template<class T> struct slab_new;
+
+	bool for_each(const std::function<bool (const slab_pool &)> &);
+}
+
+/// Cache of objects of one size.
+///
+/// Each thread keeps two magazines (arrays of free objects) per pool and
+/// allocates and frees into them without synchronization. Only when both
+/// are exhausted (or full) does the thread exchange a magazine with the
+/// pool's depot under its mutex; so the depot is visited once per magazine
+/// of operations at worst. When the depot is empty a new slab of objects is
+/// allocated to fill a magazine. Memory is kept by the pool and only
+/// released at its destruction.
+///
+/// Pools are usually static; there is one for each type with slab<T>, or
+/// they can be made for sizes directly. Construction is constant so static
+/// pools are ready before any dynamic initialization uses them; a pool is
+/// registered (and given its thread cache index) when first used. A pool
+/// being destroyed takes its magazines back from every thread still running
+/// and its index is then reused by the next pool registered.
+struct ircd::allocator::slab_pool
+{
+	struct magazine;
+	struct cache;
+	struct caches;
+
+	static constexpr size_t magazine_size {32};
+
+	string_view name;
+	const std::type_info *type {nullptr};        // Names the pool at registration
+	size_t size;                                 // Of each object
+	size_t align;                                // Of each object
+	size_t id {size_t(-1)};                      // Index of thread cache
+	slab_pool *next {nullptr};                   // Registry of all pools
+
+	std::mutex mutex;
+	std::vector<magazine *> full;                // Depot
+	std::vector<magazine *> empty;               // Depot
+	std::vector<void *> slabs;                   // Allocated memory
+
+	std::atomic<uint64_t> live {0};              // Objects allocated now
+	std::atomic<uint64_t> peak {0};              // Most allocated at once
+	std::atomic<uint64_t> allocs {0};            // Total allocations
+	std::atomic<uint64_t> depot {0};             // Visits to the depot
+	std::atomic<uint64_t> grows {0};             // Slabs allocated
+
+  private:
+	static cache &local(slab_pool &);
+	void enlist() noexcept;
+	magazine *exchange(magazine *, const bool &want_full);
+	magazine *grow();
+
+  public:
+	[[gnu::malloc, gnu::returns_nonnull]] void *allocate();
+	void deallocate(void *) noexcept;
+
+	constexpr slab_pool(const string_view &name, const size_t &size, const size_t &align = alignof(std::max_align_t));
+	constexpr slab_pool(const std::type_info &, const size_t &size, const size_t &align);
+	slab_pool(slab_pool &&) = delete;
+	slab_pool(const slab_pool &) = delete;
+	~slab_pool() noexcept;
+};
+
+/// std:: allocator for single objects of T from the type's pool; arrays are
+/// given to operator new. The pool is named after the type unless it is
+/// specialized; e.g. in the unit which defines T:
+///
+/// `template<> slab_pool slab<T>::pool {"name", sizeof(T), alignof(T)};`
+///
+template<class T>
+struct ircd::allocator::slab
+{
+	using value_type = T;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+
+	static slab_pool pool;
+
+	template<class U> struct rebind
+	{
+		using other = slab<U>;
+	};
+
+	[[gnu::malloc, gnu::returns_nonnull]]
+	T *allocate(const size_type &n)
+	{
+		if(likely(n == 1))
+			return static_cast<T *>(pool.allocate());
+
+		return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+	}
+
+	void deallocate(T *const p, const size_type &n) noexcept
+	{
+		if(likely(n == 1))
+			return pool.deallocate(p);
+
+		::operator delete(p, n * sizeof(T), std::align_val_t(alignof(T)));
+	}
+
+	template<class U>
+	bool operator==(const slab<U> &) const noexcept
+	{
+		return true;
+	}
+
+	template<class U>
+	bool operator!=(const slab<U> &) const noexcept
+	{
+		return false;
+	}
+
+	template<class U>
+	slab(const slab<U> &) noexcept
+	{}
+
+	slab() = default;
+};
+
+template<class T>
+constinit ircd::allocator::slab_pool
+ircd::allocator::slab<T>::pool
+{
+	typeid(T), sizeof(T), alignof(T)
+};
+
+constexpr
+ircd::allocator::slab_pool::slab_pool(const string_view &name,
+                                      const size_t &size,
+                                      const size_t &align)
+:name{name}
+,size{pad_to(std::max(size, sizeof(void *)), std::max(align, sizeof(void *)))}
+,align{std::max(align, sizeof(void *))}
+{}
+
+constexpr
+ircd::allocator::slab_pool::slab_pool(const std::type_info &type,
+                                      const size_t &size,
+                                      const size_t &align)
+:slab_pool{string_view{}, size, align}
+{
+	this->type = &type;
+}
+
+/// Inherit to allocate instances of T with new from slab<T>. Objects of a
+/// larger derived type are given to the global operator new.
+template<class T>
+struct ircd::allocator::slab_new
+{
+	static void *operator new(const size_t size)
+	{
+		if(likely(size == sizeof(T)))
+			return slab<T>::pool.allocate();
+
+		return ::operator new(size);
+	}
+
+	static void operator delete(void *const ptr, const size_t size) noexcept
+	{
+		if(likely(size == sizeof(T)))
+			return slab<T>::pool.deallocate(ptr);
+
+		::operator delete(ptr, size);
+	}
+};
@@ -14,6 +14,8 @@ struct ircd::allocator::state
 	using word_t                                 = unsigned long long;
 	using size_type                              = std::size_t;
 
+	static constexpr uint word_bits              { sizeof(word_t) * 8                              };
+
 	size_t size                                  { 0                                               };
 	word_t *avail                                { nullptr                                         };
 	size_t last                                  { 0                                               };
@@ -25,9 +27,15 @@ struct ircd::allocator::state
 	bool test(const uint &pos) const             { return avail[byte(pos)] & mask(pos);            }
 	void bts(const uint &pos)                    { avail[byte(pos)] |= mask(pos);                  }
 	void btc(const uint &pos)                    { avail[byte(pos)] &= ~mask(pos);                 }
+	bool test(const uint &pos, const size_t &n) const;
+	void bts(const uint &pos, const size_t &n);
+	void btc(const uint &pos, const size_t &n);
+	uint find(const bool &val, const uint &pos, const uint &end) const;
+	uint next(const size_t &n, const uint &pos, const uint &end) const;
 	uint next(const size_t &n) const;
 
   public:
+	size_t used() const;
 	bool available(const size_t &n = 1) const;
 	void deallocate(const uint &p, const size_t &n);
 	uint allocate(std::nothrow_t, const size_t &n, const uint &hint = -1);
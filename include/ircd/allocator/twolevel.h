@@ -3,21 +3,90 @@
 
 namespace ircd::allocator
 {
+	struct twolevel_site;
+
 	template<class T = char,
 	         size_t L0_SIZE = 512>
 	struct twolevel;
+
+	template<class T = char>
+	struct adaptive_twolevel;
+
+	bool for_each(const std::function<bool (const twolevel_site &)> &);
+}
+
+/// Counters for the twolevel allocators of one site. Each instantiation of
+/// twolevel has a site of its own named after the (demangled) type;
+/// otherwise a static site can be given to the instances made in one place.
+/// Sites are registered for reporting while they exist.
+struct ircd::allocator::twolevel_site
+{
+	std::string type_name;                       // Holds the name of a type's site
+	string_view name;
+	size_t l0_size {0};                          // L0 capacity in objects
+	twolevel_site *next {nullptr};               // Registry of all sites
+
+	std::atomic<uint64_t> hits {0};              // Allocations from L0
+	std::atomic<uint64_t> spills {0};            // Allocations given to L1
+	std::atomic<size_t> peak {0};                // Most of L0 in use at once
+	std::atomic<size_t> demand {0};              // Most of L0 and L1 at once
+
+  private:
+	static void raise(std::atomic<size_t> &, const size_t &) noexcept;
+
+  public:
+	void hit(const size_t &l0_live, const size_t &total) noexcept;
+	void spill(const size_t &total) noexcept;
+
+	twolevel_site(const std::type_info &, const size_t &l0_size = 0);
+	twolevel_site(const string_view &name, const size_t &l0_size = 0);
+	twolevel_site(twolevel_site &&) = delete;
+	twolevel_site(const twolevel_site &) = delete;
+	~twolevel_site() noexcept;
+};
+
+inline void
+ircd::allocator::twolevel_site::hit(const size_t &l0_live,
+                                    const size_t &total)
+noexcept
+{
+	hits.fetch_add(1, std::memory_order_relaxed);
+	raise(peak, l0_live);
+	raise(demand, total);
+}
+
+inline void
+ircd::allocator::twolevel_site::spill(const size_t &total)
+noexcept
+{
+	spills.fetch_add(1, std::memory_order_relaxed);
+	raise(demand, total);
+}
+
+inline void
+ircd::allocator::twolevel_site::raise(std::atomic<size_t> &mark,
+                                      const size_t &val)
+noexcept
+{
+	size_t cur(mark.load(std::memory_order_relaxed));
+	while(val > cur && !mark.compare_exchange_weak(cur, val, std::memory_order_relaxed));
 }
 
 /// The twolevel allocator uses both a fixed allocator (first level) and then
 /// the standard allocator (second level) when the fixed allocator is exhausted.
 /// This has the intent that the fixed allocator will mostly be used, but the
 /// fallback to the standard allocator is seamlessly available for robustness.
+/// How often that happens is counted by the site.
 template<class T,
          size_t L0_SIZE>
 struct ircd::allocator::twolevel
 {
 	struct allocator;
 
+	static twolevel_site default_site;
+
+	twolevel_site *site {&default_site};
+	size_t live[2] {0, 0};                       // Objects in each level
 	fixed<T, L0_SIZE> l0;
 	std::allocator<T> l1;
 
@@ -25,9 +94,21 @@ struct ircd::allocator::twolevel
 	allocator operator()();
 	operator allocator();
 
+	twolevel(twolevel_site &site)
+	:site{&site}
+	{}
+
 	twolevel() = default;
 };
 
+template<class T,
+         size_t L0_SIZE>
+ircd::allocator::twolevel_site
+ircd::allocator::twolevel<T, L0_SIZE>::default_site
+{
+	typeid(T), L0_SIZE
+};
+
 template<class T,
          size_t L0_SIZE>
 struct ircd::allocator::twolevel<T, L0_SIZE>::allocator
@@ -70,16 +151,25 @@ struct ircd::allocator::twolevel<T, L0_SIZE>::allocator
 	allocate(const size_type &n, const const_pointer &hint = nullptr)
 	{
 		assert(s);
-		return
-			s->l0.allocate(std::nothrow, n, hint)?:
-			s->l1.allocate(n, hint);
+		if(const auto ret(s->l0().allocate(std::nothrow, n, hint)); likely(ret))
+		{
+			s->live[0] += n;
+			s->site->hit(s->live[0], s->live[0] + s->live[1]);
+			return ret;
+		}
+
+		s->live[1] += n;
+		s->site->spill(s->live[0] + s->live[1]);
+		return s->l1.allocate(n);
 	}
 
 	void deallocate(const pointer &p, const size_type &n)
 	{
 		assert(s);
-		if(likely(s->l0.in_range(p)))
-			s->l0.deallocate(p, n);
+		const bool l0(s->l0.in_range(p));
+		s->live[!l0] -= n;
+		if(likely(l0))
+			s->l0().deallocate(p, n);
 		else
 			s->l1.deallocate(p, n);
 	}
@@ -124,4 +214,146 @@ inline ircd::allocator::twolevel<T, L0_SIZE>::operator
 allocator()
 {
 	return ircd::allocator::twolevel<T, L0_SIZE>::allocator(*this);
-}
\ No newline at end of file
+}
+
+/// twolevel with its first level sized at construction from what instances
+/// of the same site have needed: the peak of objects held at once, rounded
+/// up to a power of two no less than a bitmap word and no more than max.
+/// The first instance of a site starts at the smallest size. L0 is a single
+/// allocation (a dynamic allocator) so instances don't carry capacity they
+/// don't use.
+template<class T>
+struct ircd::allocator::adaptive_twolevel
+{
+	struct allocator;
+
+	static_assert(alignof(T) <= 16);
+
+	twolevel_site *site;
+	size_t live[2] {0, 0};                       // Objects in each level
+	dynamic<T> l0;
+	std::allocator<T> l1;
+
+	static size_t l0_size(const twolevel_site &, const size_t &max);
+
+  public:
+	bool in_range(const T *const &ptr) const
+	{
+		return ptr >= l0.buf && ptr < l0.buf + l0.size;
+	}
+
+	allocator operator()();
+	operator allocator();
+
+	adaptive_twolevel(twolevel_site &site, const size_t &max = 4096)
+	:site{&site}
+	,l0{l0_size(site, max)}
+	{
+		std::fill(l0.avail, l0.avail + l0.size / state::word_bits, 0);
+		site.l0_size = l0.size;
+	}
+
+	adaptive_twolevel(adaptive_twolevel &&) = delete;
+	adaptive_twolevel(const adaptive_twolevel &) = delete;
+};
+
+template<class T>
+inline size_t
+ircd::allocator::adaptive_twolevel<T>::l0_size(const twolevel_site &site,
+                                               const size_t &max)
+{
+	const size_t min(state::word_bits);
+	const size_t want(std::max(site.demand.load(std::memory_order_relaxed), min));
+	const size_t pow2(size_t(1) << (64 - __builtin_clzl(want - 1)));
+	return std::max(std::min(pow2, pad_to(max, min)), min);
+}
+
+template<class T>
+struct ircd::allocator::adaptive_twolevel<T>::allocator
+{
+	using value_type         = T;
+	using pointer            = T *;
+	using const_pointer      = const T *;
+	using reference          = T &;
+	using const_reference    = const T &;
+	using size_type          = std::size_t;
+	using difference_type    = std::ptrdiff_t;
+
+	adaptive_twolevel *s;
+
+  public:
+	template<class U> struct rebind
+	{
+		using other = typename adaptive_twolevel<U>::allocator;
+	};
+
+	size_type max_size() const
+	{
+		return std::numeric_limits<size_type>::max();
+	}
+
+	pointer
+	__attribute__((malloc, returns_nonnull, warn_unused_result))
+	allocate(const size_type &n, const const_pointer &hint = nullptr)
+	{
+		assert(s);
+		const uint hintpos(hint && s->in_range(hint)? uint(hint - s->l0.buf) : uint(-1));
+		if(const auto pos(s->l0.state::allocate(std::nothrow, n, hintpos)); likely(pos < s->l0.size))
+		{
+			s->live[0] += n;
+			s->site->hit(s->live[0], s->live[0] + s->live[1]);
+			return s->l0.buf + pos;
+		}
+
+		s->live[1] += n;
+		s->site->spill(s->live[0] + s->live[1]);
+		return s->l1.allocate(n);
+	}
+
+	void deallocate(const pointer &p, const size_type &n)
+	{
+		assert(s);
+		const bool l0(s->in_range(p));
+		s->live[!l0] -= n;
+		if(likely(l0))
+			s->l0.state::deallocate(p - s->l0.buf, n);
+		else
+			s->l1.deallocate(p, n);
+	}
+
+	template<class U>
+	allocator(const typename adaptive_twolevel<U>::allocator &s) noexcept
+	:s{reinterpret_cast<adaptive_twolevel *>(s.s)}
+	{}
+
+	allocator(adaptive_twolevel &s) noexcept
+	:s{&s}
+	{}
+
+	allocator(allocator &&) = default;
+	allocator(const allocator &) = default;
+
+	friend bool operator==(const allocator &a, const allocator &b)
+	{
+		return a.s == b.s;
+	}
+
+	friend bool operator!=(const allocator &a, const allocator &b)
+	{
+		return a.s != b.s;
+	}
+};
+
+template<class T>
+inline typename ircd::allocator::adaptive_twolevel<T>::allocator
+ircd::allocator::adaptive_twolevel<T>::operator()()
+{
+	return ircd::allocator::adaptive_twolevel<T>::allocator(*this);
+}
+
+template<class T>
+inline ircd::allocator::adaptive_twolevel<T>::operator
+allocator()
+{
+	return ircd::allocator::adaptive_twolevel<T>::allocator(*this);
+}
@@ -111,6 +111,7 @@ namespace boost::asio::detail
 
 // Boost version dependent behavior for getting the io_service/io_context
 // abstract executor (recent versions) or the derived instance (old versions).
+// On a shard thread these resolve to the shard's loop rather than main.
 namespace ircd::ios
 {
 	extern asio::executor user, main;
@@ -139,6 +140,9 @@ inline boost::asio::executor &
 ircd::ios::get()
 noexcept
 {
+	if(unlikely(shard::current))
+		return *shard::current->executor;
+
 	assert(bool(main));
 	return main;
 }
@@ -147,11 +151,107 @@ inline boost::asio::io_context &
 ircd::ios::get()
 noexcept
 {
+	if(unlikely(shard::current))
+		return *shard::current->context;
+
 	auto &context(mutable_cast(main.context()));
 	return static_cast<asio::io_context &>(context);
 }
 #endif
 
+// Templates from ios/dispatch.h which can only be defined once boost::asio
+// has been included.
+
+template<class function>
+inline
+ircd::ios::dispatch::dispatch(descriptor &descriptor,
+                              defer_t,
+                              typed_t,
+                              function &&f)
+{
+	boost::asio::post(get(), handle
+	{
+		descriptor, std::forward<function>(f)
+	});
+}
+
+template<class function>
+inline
+ircd::ios::dispatch::dispatch(descriptor &descriptor,
+                              typed_t,
+                              function &&f)
+{
+	const auto parent(handler::current); try
+	{
+		assert(!ctx::current && handler::current);
+		ios::handler::leave(parent);
+
+		assert(!ctx::current && !handler::current);
+		boost::asio::dispatch(get(), handle
+		{
+			descriptor, std::forward<function>(f)
+		});
+
+		assert(!ctx::current && !handler::current);
+		ios::handler::enter(parent);
+	}
+	catch(...)
+	{
+		assert(!ctx::current && !handler::current);
+		ios::handler::enter(parent);
+
+		assert(!ctx::current && handler::current == parent);
+		throw;
+	}
+
+	assert(!ctx::current && handler::current == parent);
+}
+
+template<class function>
+inline
+ircd::ios::dispatch::dispatch(shard &shard,
+                              descriptor &descriptor,
+                              defer_t,
+                              typed_t,
+                              function &&f)
+{
+	assert(shard.context);
+	boost::asio::post(*shard.context, handle
+	{
+		descriptor, std::forward<function>(f)
+	});
+}
+
+template<class container>
+inline
+ircd::ios::dispatch_batch::dispatch_batch(descriptor &descriptor,
+                                          defer_t,
+                                          container &&c)
+{
+	if(std::empty(c))
+		return;
+
+	boost::asio::post(get(), handle
+	{
+		descriptor, [batch(std::decay_t<container>(std::forward<container>(c)))]
+		{
+			std::exception_ptr eptr;
+			for(const auto &function : batch) try
+			{
+				function();
+			}
+			catch(...)
+			{
+				if(!eptr)
+					eptr = std::current_exception();
+			}
+
+			if(unlikely(eptr))
+				std::rethrow_exception(eptr);
+		}
+	});
+}
+
 // Workaround for bug in io_uring_service::get_sqe(). We have to aim upstream
 // because we can't get to it directly; this won't affect other users in the
 // address space; if LIBURING_INTERNAL ever has another meaning sometime in
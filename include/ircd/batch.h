@@ -0,0 +1,38 @@
+#pragma once
+#define HAVE_IRCD_BATCH_H
+
+/// Parallel kernels for batches of buffers.
+///
+/// Each kernel runs on the ctx::ole workers. The batch is split into chunks
+/// of about chunk_size input bytes which the workers take in turn, so a large
+/// batch becomes a few offloads rather than one per buffer. The calling
+/// context yields until the whole batch is done. Results are written to the
+/// caller's preallocated array at the index of each input. The kernels
+/// return false without doing anything when the library providing their
+/// algorithm is not available in this build.
+namespace ircd::batch
+{
+	enum class codec :uint8_t;
+	using sha256_buf = std::array<uint8_t, 32>;
+
+	extern size_t chunk_size;
+
+	void for_each(const vector_view<const const_buffer> &, const std::function<void (const size_t &)> &);
+
+	// Digest of each input.
+	bool sha256(const vector_view<sha256_buf> &out, const vector_view<const const_buffer> &in);
+
+	// Each output buffer is shrunk to the compressed size; emptied if the
+	// input did not fit.
+	bool compress(const vector_view<mutable_buffer> &out, const vector_view<const const_buffer> &in, const codec &, const int &level = 0);
+
+	// Ed25519 verification of each message with its signature and key.
+	bool verify(const vector_view<bool> &out, const vector_view<const const_buffer> &msg, const vector_view<const const_buffer> &sig, const vector_view<const const_buffer> &pk);
+}
+
+enum class ircd::batch::codec
+:uint8_t
+{
+	LZ4,
+	ZSTD,
+};
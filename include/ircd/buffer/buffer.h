@@ -32,6 +32,7 @@ namespace ircd::buffer
 	template<class buffer, size_t SIZE> struct fixed_buffer;
 	template<class buffer> struct unique_buffer;
 	template<class buffer> struct shared_buffer;
+	template<class buffer, bool ATOMIC = false> struct rc_buffer;
 
 	template<size_t SIZE> using fixed_const_buffer = fixed_buffer<const_buffer, SIZE>;
 	template<size_t SIZE> using fixed_mutable_buffer = fixed_buffer<mutable_buffer, SIZE>;
@@ -39,6 +40,8 @@ namespace ircd::buffer
 	using unique_mutable_buffer = unique_buffer<mutable_buffer>;
 	using shared_const_buffer = shared_buffer<const_buffer>;
 	using shared_mutable_buffer = shared_buffer<mutable_buffer>;
+	using rc_const_buffer = rc_buffer<const_buffer>;
+	using rc_mutable_buffer = rc_buffer<mutable_buffer>;
 
 	// Convenience null buffer
 	[[clang::internal_linkage]] extern const mutable_buffer null_buffer;
@@ -84,6 +87,7 @@ namespace ircd::buffer
 #include "fixed_buffer.h"
 #include "unique_buffer.h"
 #include "shared_buffer.h"
+#include "rc_buffer.h"
 #include "window_buffer.h"
 #include "parse_buffer.h"
 #include "buffers.h"
@@ -98,6 +102,7 @@ namespace ircd
 	using buffer::fixed_buffer;
 	using buffer::unique_buffer;
 	using buffer::shared_buffer;
+	using buffer::rc_buffer;
 	using buffer::null_buffer;
 	using buffer::window_buffer;
 	using buffer::fixed_const_buffer;
@@ -106,6 +111,8 @@ namespace ircd
 	using buffer::unique_mutable_buffer;
 	using buffer::shared_const_buffer;
 	using buffer::shared_mutable_buffer;
+	using buffer::rc_const_buffer;
+	using buffer::rc_mutable_buffer;
 	using buffer::null_buffer;
 
 	using buffers::const_buffers;
@@ -0,0 +1,280 @@
+#pragma once
+#define HAVE_IRCD_BUFFER_RC_BUFFER_H
+
+/// Pools for rc_buffer.
+///
+/// The reference count is kept in a header allocated in the same block just
+/// before the data, so a buffer costs one allocation however many hold it.
+/// Blocks are rounded up to a size class (powers of two from class_min to
+/// class_max) and freed blocks are cached per thread for reuse by the next
+/// allocation of their class. Larger buffers are allocated and freed
+/// directly. A block freed on another thread than allocated it is cached by
+/// the thread freeing it; a full cache spills half a class to a shared depot
+/// which every thread refills from, and exiting threads give theirs to it.
+/// The depot is freed under memory pressure (see allocator::pressure).
+namespace ircd::buffer::rc
+{
+	struct header;
+	struct stats;
+
+	constexpr size_t class_min {64};
+	constexpr size_t class_max {64 * 1024};
+	constexpr size_t classes {11};               // class_min << 10 == class_max
+
+	extern size_t cache_bytes;                   // Cached per class per thread
+	extern struct stats stats;
+
+	header *allocate(const size_t &size);
+	void deallocate(header *const &) noexcept;
+	size_t trim() noexcept;
+}
+
+struct alignas(std::max_align_t) ircd::buffer::rc::header
+{
+	size_t refs {1};
+	uint32_t cls {0};                            // Size class; classes if none
+
+	char *data() noexcept                        { return reinterpret_cast<char *>(this + 1);      }
+};
+
+struct ircd::buffer::rc::stats
+{
+	std::atomic<uint64_t> allocs {0};
+	std::atomic<uint64_t> reuses {0};            // Allocs served from a cache
+	std::atomic<uint64_t> depot {0};             // Caches refilled from the depot
+	std::atomic<uint64_t> outsized {0};          // Allocs over class_max
+	std::atomic<uint64_t> frees {0};
+};
+
+/// Like shared_buffer, this template shares ownership of an allocated buffer;
+/// but the count is intrusive (see rc::) so copying only increments it. By
+/// default the count is not atomic and the copies must all stay on one
+/// thread, as on the main loop: fanning one serialized message out to every
+/// client is then one allocation and a plain increment per client. With
+/// ATOMIC the copies may be released on any thread.
+///
+/// A mutable buffer converts to a const buffer sharing the same count, i.e.
+/// to fill the buffer and then hand it out read-only.
+template<class buffer_type,
+         bool ATOMIC>
+struct ircd::buffer::rc_buffer
+:buffer_type
+{
+	rc::header *hdr {nullptr};
+
+  private:
+	void ref() noexcept;
+	void unref() noexcept;
+
+  public:
+	size_t use_count() const noexcept;
+	explicit operator bool() const;
+	bool operator!() const;
+
+	explicit rc_buffer(const size_t &size);
+	explicit rc_buffer(const const_buffer &);
+	template<class T> rc_buffer(const rc_buffer<T, ATOMIC> &) noexcept;
+	rc_buffer() = default;
+	rc_buffer(rc_buffer &&) noexcept;
+	rc_buffer(const rc_buffer &) noexcept;
+	rc_buffer &operator=(rc_buffer &&) & noexcept;
+	rc_buffer &operator=(const rc_buffer &) & noexcept;
+	~rc_buffer() noexcept;
+};
+
+template<class buffer_type,
+         bool ATOMIC>
+inline
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::rc_buffer(const const_buffer &src)
+:rc_buffer
+{
+	ircd::buffer::size(src)
+}
+{
+	using ircd::buffer::size;
+
+	const mutable_buffer dst
+	{
+		hdr->data(), size(src)
+	};
+
+	copy(dst, src);
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::rc_buffer(const size_t &size)
+:hdr
+{
+	rc::allocate(size)
+}
+{
+	static_cast<buffer_type &>(*this) = buffer_type
+	{
+		hdr->data(), size
+	};
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+template<class other_type>
+inline
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::rc_buffer(const rc_buffer<other_type, ATOMIC> &other)
+noexcept
+:buffer_type
+{
+	data(other), size(other)
+}
+,hdr
+{
+	other.hdr
+}
+{
+	ref();
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::rc_buffer(rc_buffer &&other)
+noexcept
+:buffer_type
+{
+	static_cast<const buffer_type &>(other)
+}
+,hdr
+{
+	std::exchange(other.hdr, nullptr)
+}
+{
+	static_cast<buffer_type &>(other) = buffer_type{};
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::rc_buffer(const rc_buffer &other)
+noexcept
+:buffer_type
+{
+	static_cast<const buffer_type &>(other)
+}
+,hdr
+{
+	other.hdr
+}
+{
+	ref();
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline ircd::buffer::rc_buffer<buffer_type, ATOMIC> &
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::operator=(rc_buffer &&other)
+& noexcept
+{
+	if(likely(this != &other))
+	{
+		unref();
+		hdr = std::exchange(other.hdr, nullptr);
+		static_cast<buffer_type &>(*this) = static_cast<const buffer_type &>(other);
+		static_cast<buffer_type &>(other) = buffer_type{};
+	}
+
+	return *this;
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline ircd::buffer::rc_buffer<buffer_type, ATOMIC> &
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::operator=(const rc_buffer &other)
+& noexcept
+{
+	if(likely(hdr != other.hdr))
+	{
+		unref();
+		hdr = other.hdr;
+		ref();
+	}
+
+	static_cast<buffer_type &>(*this) = static_cast<const buffer_type &>(other);
+	return *this;
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::~rc_buffer()
+noexcept
+{
+	unref();
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline void
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::unref()
+noexcept
+{
+	if(!hdr)
+		return;
+
+	if constexpr(ATOMIC)
+	{
+		if(std::atomic_ref<size_t>(hdr->refs).fetch_sub(1, std::memory_order_acq_rel) == 1)
+			rc::deallocate(hdr);
+	}
+	else if(--hdr->refs == 0)
+		rc::deallocate(hdr);
+
+	hdr = nullptr;
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline void
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::ref()
+noexcept
+{
+	if(!hdr)
+		return;
+
+	if constexpr(ATOMIC)
+		std::atomic_ref<size_t>(hdr->refs).fetch_add(1, std::memory_order_relaxed);
+	else
+		++hdr->refs;
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline size_t
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::use_count()
+const noexcept
+{
+	if(!hdr)
+		return 0;
+
+	if constexpr(ATOMIC)
+		return std::atomic_ref<size_t>(hdr->refs).load(std::memory_order_relaxed);
+	else
+		return hdr->refs;
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline bool
+ircd::buffer::rc_buffer<buffer_type, ATOMIC>::operator!()
+const
+{
+	return this->buffer_type::empty();
+}
+
+template<class buffer_type,
+         bool ATOMIC>
+inline ircd::buffer::rc_buffer<buffer_type, ATOMIC>::operator
+bool()
+const
+{
+	return !this->buffer_type::empty();
+}
@@ -19,10 +19,54 @@ namespace ircd::ctx
 	using ole::offload;
 }
 
+namespace ircd::ctx::ole
+{
+	struct stats;
+
+	extern size_t thread_max;
+	extern size_t starve_normal;
+	extern size_t starve_low;
+
+	// Workers running now; after lowering thread_max, retire() has those
+	// beyond it exit.
+	size_t workers() noexcept;
+	void retire() noexcept;
+
+	// Worker placement; applies to workers started after it is set.
+	extern std::vector<uint> cpus;
+	extern bool isolate;
+	extern bool numa_local;
+
+	// Completion delivery; drain_total / drain_count is the number of
+	// offloads completed by each handler run on the event loop.
+	extern std::atomic<uint64_t> drain_count;
+	extern std::atomic<uint64_t> drain_total;
+	extern std::atomic<uint64_t> drain_max;
+
+	bool for_each(const std::function<bool (const string_view &name, const stats &)> &);
+
+	void submit(const opts &, std::function<void ()> work, std::function<void ()> done);
+
+	template<class F,
+	         class R = std::invoke_result_t<F>>
+	future<R> async(const opts &, F&&);
+
+	template<class F,
+	         class R = std::invoke_result_t<F>>
+	future<R> async(F&&);
+}
+
+/// Offload the function and yield the calling context until it returns or
+/// throws. With opts::concurrency of N the function is run N times on up to
+/// N workers in parallel; the ranked form is given the index [0, N) of each
+/// invocation to partition the work. The first exception thrown by any
+/// invocation is rethrown after all have completed.
 struct ircd::ctx::ole::offload
 {
 	using function = std::function<void ()>;
+	using ranked_function = std::function<void (const size_t &rank)>;
 
+	offload(const opts &, const ranked_function &);
 	offload(const opts &, const function &);
 	offload(const function &);
 };
@@ -32,16 +76,95 @@ struct ircd::ctx::ole::opts
 	/// Optionally give this offload task a name for any tasklist.
 	string_view name;
 
-	/// The function will be executed on each thread.
+	/// The function will be executed on each thread. Invocations beyond the
+	/// number of workers (thread_max) queue for the next available worker.
 	size_t concurrency {1};
 
-	/// Queuing priority; in the form of a nice value.
+	/// Queuing priority; in the form of a nice value. Negative values are
+	/// queued ahead of zero, and zero ahead of positive values; the value
+	/// within each of those classes is not significant.
 	int8_t prio {0};
 };
 
+/// Statistics for offloads sharing an opts::name; times are in cycles.
+struct ircd::ctx::ole::stats
+{
+	std::atomic<uint64_t> queued {0};      // Tasks waiting now
+	std::atomic<uint64_t> queued_max {0};  // Most tasks waiting at once
+	std::atomic<uint64_t> count {0};       // Tasks started
+	std::atomic<uint64_t> wait_total {0};  // Sum of time waited to start
+	std::atomic<uint64_t> wait_max {0};    // Longest time waited to start
+};
+
 struct [[gnu::visibility("hidden")]]
 ircd::ctx::ole::init
 {
 	init();
 	~init() noexcept;
 };
+
+/// Offload without waiting. The returned future is satisfied with the
+/// function's result, or with the exception it threw, on the calling
+/// context's event loop; many offloads may be in flight from one context.
+/// The function must be copyable; it runs once, as opts::concurrency is
+/// taken to be 1 whatever it is.
+template<class F,
+         class R>
+inline ircd::ctx::future<R>
+ircd::ctx::ole::async(const opts &opts,
+                      F&& f)
+{
+	struct result
+	{
+		std::conditional_t<std::is_void_v<R>, bool, std::optional<R>> value;
+		std::exception_ptr eptr;
+	};
+
+	// Concurrent invocations would all write the one result.
+	auto single(opts);
+	single.concurrency = 1;
+
+	const auto res
+	{
+		std::allocate_shared<result>(allocator::slab<result>{})
+	};
+
+	promise<R> p;
+	future<R> ret{p};
+	submit(single, [res, f(std::forward<F>(f))]
+	() mutable noexcept
+	{
+		try
+		{
+			if constexpr(std::is_void_v<R>)
+				f();
+			else
+				res->value.emplace(f());
+		}
+		catch(...)
+		{
+			res->eptr = std::current_exception();
+		}
+	},
+	[res, p(std::move(p))]
+	() mutable
+	{
+		if(res->eptr)
+			p.set_exception(std::move(res->eptr));
+		else if constexpr(std::is_void_v<R>)
+			p.set_value();
+		else
+			p.set_value(std::move(*res->value));
+	});
+
+	return ret;
+}
+
+template<class F,
+         class R>
+inline ircd::ctx::future<R>
+ircd::ctx::ole::async(F&& f)
+{
+	const opts opts;
+	return async(opts, std::forward<F>(f));
+}
@@ -16,6 +16,7 @@ struct ircd::ctx::pool
 
 	static const string_view default_name;
 	static const opts default_opts;
+	static thread_local pool *list;             // Registry of this thread's pools
 
 	string_view name {default_name};
 	const opts *opt {&default_opts};
@@ -24,9 +25,12 @@ struct ircd::ctx::pool
 	dock q_max;
 	queue<closure> q;
 	std::vector<context> ctxs;
+	size_t shedding {0};
+	pool *next {nullptr};
 
   private:
-	void work();
+	void reap();
+	bool work();
 	void main() noexcept;
 
   public:
@@ -50,6 +54,7 @@ struct ircd::ctx::pool
 	void del(const size_t & = 1);
 	void set(const size_t &);
 	void min(const size_t &);
+	size_t shrink(const size_t &keep = 0);
 	void terminate();
 	void interrupt();
 	void join();
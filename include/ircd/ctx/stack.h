@@ -17,6 +17,8 @@ struct ircd::ctx::stack
 {
 	struct allocator;
 
+	static bool hugepage;                  // Allocate from allocator::hugepage (at spawn)
+
 	mutable_buffer buf;                    // complete allocation
 	uintptr_t base {0};                    // base frame pointer
 	size_t max {0};                        // User given stack size
@@ -34,6 +36,7 @@ ircd::ctx::stack::allocator
 {
 	mutable_buffer &buf;
 	bool owner {false};
+	bool hugepage {false};
 
 	void deallocate(boost::coroutines::stack_context &) noexcept;
 	void allocate(boost::coroutines::stack_context &, size_t size);
@@ -0,0 +1,85 @@
+#pragma once
+#define HAVE_IRCD_FS_H
+
+/// Filesystem I/O which does not block the event loop.
+///
+/// Each call yields the calling context while the system call is made on a
+/// ctx::ole worker; other contexts continue to run during a disk stall. The
+/// operations are named "ircd.fs.<op>" for the ole statistics, and also kept
+/// here as the latency observed by the callers. Outside of any context the
+/// system call is made directly. Errors are thrown as std::system_error.
+namespace ircd::fs
+{
+	struct fd;
+	struct stats;
+	enum class op :uint8_t;
+
+	const stats &opstats(const op &) noexcept;
+
+	// Read until the buffer is full or EOF; returns the portion read.
+	mutable_buffer read(const fd &, const mutable_buffer &);
+	mutable_buffer pread(const fd &, const mutable_buffer &, const off_t &offset);
+
+	// Write the whole buffer; returns it.
+	const_buffer write(const fd &, const const_buffer &);
+
+	// Gather write of all the buffers with writev(2); returns the bytes.
+	size_t write(const fd &, const vector_view<const const_buffer> &);
+
+	void fsync(const fd &, const bool &metadata = true);
+	void fallocate(const fd &, const off_t &offset, const size_t &length, const int &mode = 0);
+}
+
+enum class ircd::fs::op
+:uint8_t
+{
+	OPEN,
+	READ,
+	WRITE,
+	SYNC,
+	ALLOCATE,
+	_NUM_
+};
+
+/// Statistics of one operation; times are in cycles as seen by the caller
+/// (i.e. including the wait for a worker).
+struct ircd::fs::stats
+{
+	std::atomic<uint64_t> count {0};       // Calls made
+	std::atomic<uint64_t> errors {0};      // Calls which threw
+	std::atomic<uint64_t> bytes {0};       // Bytes transferred
+	std::atomic<uint64_t> time_total {0};  // Sum of call latency
+	std::atomic<uint64_t> time_max {0};    // Longest call latency
+};
+
+/// File descriptor; opened through ole as well, closed directly.
+struct ircd::fs::fd
+{
+	int fdno {-1};
+
+  public:
+	explicit operator bool() const noexcept;
+	operator const int &() const noexcept;
+
+	fd(const string_view &path, const int &flags, const mode_t &mode = 0644);
+	fd() = default;
+	fd(fd &&) noexcept;
+	fd(const fd &) = delete;
+	fd &operator=(fd &&) noexcept;
+	fd &operator=(const fd &) = delete;
+	~fd() noexcept;
+};
+
+inline ircd::fs::fd::operator
+const int &()
+const noexcept
+{
+	return fdno;
+}
+
+inline ircd::fs::fd::operator
+bool()
+const noexcept
+{
+	return fdno >= 0;
+}
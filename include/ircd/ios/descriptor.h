@@ -30,6 +30,7 @@ struct ircd::ios::descriptor
 	std::vector<std::array<uint64_t, 2>> history; // epoch, cycles
 	uint8_t history_pos {0};
 	bool continuation {false};
+	allocator::attribution::entry *attribution {nullptr};
 
 	descriptor(const string_view &name,
 	           const decltype(allocator) & = default_allocator,
@@ -86,28 +87,6 @@ struct ircd::ios::descriptor::stats
 	~stats() noexcept;
 };
 
-[[gnu::hot]]
-inline void
-ircd::ios::descriptor::default_deallocator(handler &handler,
-                                           void *const ptr,
-                                           const size_t size)
-noexcept
-{
-	#ifdef __clang__
-		::operator delete(ptr);
-	#else
-		::operator delete(ptr, size);
-	#endif
-}
-
-[[gnu::hot]]
-inline void *
-ircd::ios::descriptor::default_allocator(handler &handler,
-                                         const size_t size)
-{
-	return ::operator new(size);
-}
-
 inline const ircd::string_view &
 ircd::ios::name(const descriptor &descriptor)
 {
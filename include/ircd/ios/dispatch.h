@@ -4,6 +4,7 @@
 namespace ircd::ios
 {
 	struct dispatch;
+	struct dispatch_batch;
 
 	/// Hard flag to indicate the function is not to be executed during this
 	/// epoch, and enqueued instead. This results in asynchronous behavior
@@ -14,11 +15,17 @@ namespace ircd::ios
 	/// function is executed, regardless of the mode of that execution. This
 	/// results in synchronous behavior from dispatch().
 	IRCD_OVERLOAD(yield)
+
+	/// Soft flag selecting the overloads which preserve the type of the
+	/// callable rather than erasing it into a std::function. These are only
+	/// defined by <ircd/asio.h>, which a unit passing this must include.
+	IRCD_OVERLOAD(typed)
 }
 
 namespace ircd
 {
 	using ios::dispatch;
+	using ios::dispatch_batch;
 }
 
 /// Schedule execution on the core event loop.
@@ -29,6 +36,12 @@ struct ircd::ios::dispatch
 	/// Returns directly after the function has completed.
 	dispatch(descriptor &, std::function<void ()>);
 
+	/// Direct dispatch (main stack only) preserving the type of the callable.
+	/// The function is moved directly into the ios::handle without any type
+	/// erasure. Definition requires boost::asio; see <ircd/asio.h>.
+	template<class function>
+	dispatch(descriptor &, typed_t, function &&);
+
 	/// Direct dispatch (context stacks only): a context switch will be made
 	/// but the function will be executed immediately on this stack. Returns
 	/// directly after the function has completed.
@@ -38,13 +51,45 @@ struct ircd::ios::dispatch
 	/// the main stack. Returns immediately.
 	dispatch(descriptor &, defer_t, std::function<void ()>);
 
+	/// Queued dispatch preserving the type of the callable. The function is
+	/// moved directly into the ios::handle so the only allocation is for the
+	/// handler itself. Definition requires boost::asio; see <ircd/asio.h>.
+	template<class function>
+	dispatch(descriptor &, defer_t, typed_t, function &&);
+
 	/// Queued dispatch (context stacks only): push the function to be executed
 	/// at a later epoch on the main stack, while suspending this context.
 	/// Returns sometime after the function has completed.
 	dispatch(descriptor &, defer_t, yield_t, const std::function<void ()> &);
 
+	/// Queued dispatch to another shard's event loop: push the function to
+	/// be executed on that shard's thread. Returns immediately. This is the
+	/// channel between shards; see ios/shard.h.
+	dispatch(shard &, descriptor &, defer_t, std::function<void ()>);
+
+	/// Queued dispatch to another shard preserving the type of the callable.
+	/// Definition requires boost::asio; see <ircd/asio.h>.
+	template<class function>
+	dispatch(shard &, descriptor &, defer_t, typed_t, function &&);
+
 	/// Courtesy yield (alternative to ctx::yield()). This queues a null
 	/// function and suspends this context until its completion. Intended to
 	/// allow other contexts to execute before continuing this context.
 	dispatch(descriptor &, defer_t, yield_t);
 };
+
+/// Schedule execution of many functions on the core event loop as a single
+/// handler. All functions are executed in order during one epoch under one
+/// descriptor; this costs one post to asio rather than one per function,
+/// which is the intended use for fanning out to many recipients at once.
+///
+/// Each function is executed even if a prior function in the batch threw;
+/// the first exception is rethrown after the batch completes.
+struct ircd::ios::dispatch_batch
+{
+	/// Queued dispatch of every function in the container (i.e. std::vector,
+	/// std::array) which is moved into the handler. Returns immediately.
+	/// Definition requires boost::asio; see <ircd/asio.h>.
+	template<class container>
+	dispatch_batch(descriptor &, defer_t, container &&);
+};
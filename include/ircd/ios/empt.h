@@ -34,4 +34,29 @@ namespace ircd::ios::empt
 	extern uint64_t load_med;
 	extern uint64_t load_high;
 	extern uint64_t load_stall;
+
+	// Busy-poll mode
+	extern uint64_t spin;
+	extern uint64_t spin_load;
+
+	extern uint64_t spin_count;
+	extern uint64_t spin_polls;
+	extern uint64_t spin_cycles;
+	extern uint64_t spin_hits;
+	extern uint64_t spin_events;
+
+	void pause() noexcept;
+}
+
+/// Relax the core in a spin loop.
+[[using gnu: always_inline, artificial]]
+inline void
+ircd::ios::empt::pause()
+noexcept
+{
+	#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+	#elif defined(__aarch64__)
+		asm volatile ("yield");
+	#endif
 }
@@ -15,10 +15,72 @@ namespace ircd::ios
 {
 	using epoll_wait_proto = int (int, struct ::epoll_event *, int, int);
 
+	template<epoll_wait_proto *>
+	int epoll_spin(int, struct ::epoll_event *, int, int &) noexcept;
+
 	template<epoll_wait_proto *>
 	int epoll_wait(int, struct ::epoll_event *, int, int) noexcept;
 }
 
+/// Busy-poll with non-blocking calls for up to empt::spin cycles, and no
+/// longer than the timeout in milliseconds (unless negative); the time spent
+/// is deducted from the timeout. Returns the first non-empty result, or zero
+/// when the budget is exhausted and the caller should block for what remains
+/// of the timeout.
+template<ircd::ios::epoll_wait_proto *_real_epoll_wait>
+[[gnu::hot]]
+inline int
+ircd::ios::epoll_spin(int _epfd,
+                      struct ::epoll_event *const _events,
+                      int _maxevents,
+                      int &_timeout)
+noexcept
+{
+	using clock = std::chrono::steady_clock;
+
+	const uint64_t start
+	{
+		cycles()
+	};
+
+	const auto began
+	{
+		clock::now()
+	};
+
+	const auto deadline
+	{
+		began + std::chrono::milliseconds(std::max(_timeout, 0))
+	};
+
+	int ret(0);
+	uint64_t polls(0), now(start);
+	auto elapsed(began);
+	while(now - start < empt::spin && (_timeout < 0 || elapsed < deadline))
+	{
+		ret = _real_epoll_wait(_epfd, _events, _maxevents, 0);
+		now = cycles();
+		elapsed = clock::now();
+		++polls;
+		if(ret != 0)
+			break;
+
+		empt::pause();
+	}
+
+	// Whole milliseconds spent; the remainder still blocks so timers are
+	// not fired early.
+	if(_timeout > 0)
+		_timeout -= std::min(_timeout, int(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed - began).count()));
+
+	empt::spin_count += 1;
+	empt::spin_polls += polls;
+	empt::spin_cycles += now - start;
+	empt::spin_hits += ret > 0;
+	empt::spin_events += ret & boolmask<uint>(ret > 0);
+	return ret;
+}
+
 /// This reduces the number of syscalls to epoll_wait(2), which tend to occur
 /// at the start of every epoch except in a minority of cases. These syscalls
 /// produce no ready events 99% of the time.
@@ -71,12 +133,48 @@ noexcept
 	tick -= boolmask<decltype(tick)>(call) & tick;
 	tick += boolmask<decltype(tick)>(!call) & 0x01;
 
-	const int ret
+	// Load level of this thread's last call reporting events; see spin_load.
+	thread_local uint load;
+
+	// Busy-poll instead of blocking when configured and recently loaded.
+	const bool spin
+	{
+		!peek && empt::spin && load >= empt::spin_load
+	};
+
+	// What remains of the timeout after spinning.
+	int timeout
 	{
-		call?
-			_real_epoll_wait(_epfd, _events, _maxevents, _timeout): 0
+		_timeout
 	};
 
+	// A thread blocking for events holds no references; it must not hold up
+	// qsbr reclamation for the duration.
+	if(!peek)
+		qsbr::offline();
+
+	int ret
+	{
+		spin?
+			epoll_spin<_real_epoll_wait>(_epfd, _events, _maxevents, timeout): 0
+	};
+
+	if(call && ret == 0)
+		ret = _real_epoll_wait(_epfd, _events, _maxevents, timeout);
+
+	if(!peek)
+		qsbr::online();
+
+	// Nothing arriving even by the timeout of a blocking call ends the load.
+	if(ret > 0)
+		load = 1
+		+ (ret >= _maxevents / 8)
+		+ (ret >= _maxevents / 4)
+		+ (ret >= _maxevents / 2)
+		+ (ret >= _maxevents / 1);
+	else if(!peek && ret == 0)
+		load = 0;
+
 	// Update stats
 	empt::peek += peek;
 	empt::skip += !call;
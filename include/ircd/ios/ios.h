@@ -43,7 +43,10 @@ namespace ircd::ios::profile
 
 #include "descriptor.h"
 #include "handler.h"
+#include "qsbr.h"
 #include "asio.h"
+#include "shard.h"
+#include "watchdog.h"
 #include "empt.h"
 #include "dispatch.h"
 #include "epoll.h"
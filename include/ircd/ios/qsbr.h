@@ -0,0 +1,168 @@
+#pragma once
+#define HAVE_IRCD_IOS_QSBR_H
+
+/// Quiescent-state-based reclamation.
+///
+/// Allows lock-free readers of structures shared between threads (i.e. the
+/// event loop threads, shards, and ctx::ole workers). A writer replaces the
+/// object and retires the old one; it is freed only after every registered
+/// reader thread has passed through a quiescent state since the retirement.
+///
+/// Event loop threads are quiescent at every handler epoch boundary, so a
+/// pointer obtained by a reader is valid until its handler leaves. Note that
+/// a context switch (yield) or a direct ios::dispatch leaves the handler:
+/// references must not be held across either. Other threads announce with
+/// quiescent() between units of work, and go offline() while blocking.
+///
+/// A thread which is not registered (no reader instance) cannot read safely.
+namespace ircd::ios::qsbr
+{
+	struct reader;
+	template<class T> struct ptr;
+
+	extern std::atomic<uint64_t> epoch;     // Grace period counter
+	extern std::atomic<size_t> pending;     // Retired objects not yet freed
+	extern uint64_t retired;                // Total objects retired
+	extern uint64_t reclaimed;              // Total objects freed
+
+	size_t reclaim() noexcept;
+	void retire(std::function<void ()>);
+	template<class T> void retire(T *);
+
+	void quiescent() noexcept;
+	void offline() noexcept;
+	void online() noexcept;
+}
+
+/// Registration of the calling thread as a reader. Instances must be
+/// constructed on and outlive all reads by the thread they register.
+struct ircd::ios::qsbr::reader
+{
+	static thread_local reader *current;
+
+	/// Value of qsbr::epoch seen at the last quiescent state; all-ones while
+	/// offline. Padded so readers do not share lines with each other.
+	alignas(64) std::atomic<uint64_t> seen;
+
+	reader() noexcept;
+	reader(reader &&) = delete;
+	reader(const reader &) = delete;
+	~reader() noexcept;
+};
+
+/// Pointer to a shared object which readers load without locking. Writers
+/// must be serialized by the user; each reset() retires the prior object.
+template<class T>
+struct ircd::ios::qsbr::ptr
+{
+	std::atomic<T *> p {nullptr};
+
+  public:
+	const T *get() const noexcept;
+	const T *operator->() const noexcept;
+	const T &operator*() const noexcept;
+	explicit operator bool() const noexcept;
+
+	void reset(std::unique_ptr<T> = {});
+
+	ptr() = default;
+	ptr(std::unique_ptr<T>) noexcept;
+	ptr(ptr &&) = delete;
+	ptr(const ptr &) = delete;
+	~ptr() noexcept;
+};
+
+template<class T>
+inline
+ircd::ios::qsbr::ptr<T>::ptr(std::unique_ptr<T> p)
+noexcept
+:p{p.release()}
+{}
+
+/// Readers have no further access by the time the owner is destroyed; the
+/// object is freed immediately.
+template<class T>
+inline
+ircd::ios::qsbr::ptr<T>::~ptr()
+noexcept
+{
+	delete p.load(std::memory_order_relaxed);
+}
+
+template<class T>
+inline void
+ircd::ios::qsbr::ptr<T>::reset(std::unique_ptr<T> next)
+{
+	T *const prev
+	{
+		p.exchange(next.release(), std::memory_order_acq_rel)
+	};
+
+	if(prev)
+		qsbr::retire(prev);
+}
+
+template<class T>
+inline ircd::ios::qsbr::ptr<T>::operator
+bool()
+const noexcept
+{
+	return get() != nullptr;
+}
+
+template<class T>
+inline const T &
+ircd::ios::qsbr::ptr<T>::operator*()
+const noexcept
+{
+	assert(get());
+	return *get();
+}
+
+template<class T>
+inline const T *
+ircd::ios::qsbr::ptr<T>::operator->()
+const noexcept
+{
+	return get();
+}
+
+template<class T>
+inline const T *
+ircd::ios::qsbr::ptr<T>::get()
+const noexcept
+{
+	return p.load(std::memory_order_acquire);
+}
+
+template<class T>
+inline void
+ircd::ios::qsbr::retire(T *const ptr)
+{
+	retire([ptr]
+	{
+		delete ptr;
+	});
+}
+
+/// Announce the calling thread holds no references obtained before now.
+/// Called by the event loop at the end of every handler; while objects are
+/// pending, every 64th epoch also attempts to reclaim them.
+[[using gnu: hot, always_inline]]
+inline void
+ircd::ios::qsbr::quiescent()
+noexcept
+{
+	if(!reader::current)
+		return;
+
+	const auto seen
+	{
+		epoch.load(std::memory_order_acquire)
+	};
+
+	reader::current->seen.store(seen, std::memory_order_release);
+	if(unlikely(pending.load(std::memory_order_relaxed)))
+		if((handler::epoch & 0x3f) == 0)
+			reclaim();
+}
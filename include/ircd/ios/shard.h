@@ -0,0 +1,81 @@
+#pragma once
+#define HAVE_IRCD_IOS_SHARD_H
+
+namespace ircd::ios
+{
+	struct shard;
+
+	size_t shards() noexcept;
+}
+
+/// Sharded event loops (shared-nothing).
+///
+/// Each shard is an independent asio::io_context run by its own thread which
+/// is optionally pinned to a core. Work submitted to a shard stays there:
+/// ios::get() on a shard thread resolves to that shard's io_context, so
+/// handlers and contexts spawned from a shard thread (including their alarm,
+/// signals and their registry for ctx::for_each()) belong to that shard. The
+/// shards only communicate by queuing closures to each other with the shard
+/// overloads of ios::dispatch.
+///
+/// This is an alternative to running one io_context on several threads with
+/// work stealing; per-connection workloads scale linearly if connections are
+/// distributed over the shards. The main loop (ios::main) is not a shard.
+///
+/// An exception escaping a handler on a shard is written to stderr and
+/// rethrown on the main loop, where it leaves ios::main's run() as it would
+/// have from a handler of the main loop; the shard keeps running.
+///
+/// Note that ios::descriptor statistics are not synchronized; descriptors
+/// used to queue across shards should be dedicated to that purpose. This is
+/// not true of descriptors which all contexts and their signals share (i.e.
+/// ircd.ctx.ctx and ircd.ctx.signal): their counters and the slice profiled
+/// for each context are only approximate while contexts run on shards.
+struct ircd::ios::shard
+{
+	struct opts;
+
+	static std::vector<std::unique_ptr<shard>> list;
+	static thread_local shard *current;
+
+	uint id;                                     // Index in shard::list
+	int cpu {-1};                                // Pinned core or -1 for none
+	std::unique_ptr<asio::io_context> context;   // This shard's event loop
+	std::unique_ptr<asio::executor> executor;    // Handle to the above
+	std::thread thread;                          // Thread running the loop
+	std::atomic<uint64_t> faults {0};            // Exceptions escaping handlers
+
+	static void start(const opts &);
+	static void stop() noexcept;
+
+  private:
+	void run() noexcept;
+
+  public:
+	shard(const uint &id, const int &cpu);
+	shard(shard &&) = delete;
+	shard(const shard &) = delete;
+	~shard() noexcept;
+};
+
+struct ircd::ios::shard::opts
+{
+	/// Number of shards to start; zero for one per core from cpu onward,
+	/// leaving the cores before it to the main loop (at least one shard).
+	size_t count {0};
+
+	/// Pin each shard's thread to a single core.
+	bool pin {true};
+
+	/// Core for the first shard; shard N is pinned to (cpu + N) % cores. The
+	/// default leaves core 0 for the main loop unless count asks for more
+	/// shards than there are cores after it.
+	uint cpu {1};
+};
+
+inline size_t
+ircd::ios::shards()
+noexcept
+{
+	return shard::list.size();
+}
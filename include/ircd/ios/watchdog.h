@@ -0,0 +1,42 @@
+#pragma once
+#define HAVE_IRCD_IOS_WATCHDOG_H
+
+/// Event loop stall watchdog.
+///
+/// An optional thread which samples the state of one event loop thread at a
+/// fixed interval: ios::handler::epoch, ios::handler::current and
+/// ctx::current. When the epoch has not advanced for the threshold, the loop
+/// is considered stalled by whatever is currently executing; a record is made
+/// with the descriptor and context names and a backtrace of the loop thread.
+/// The loop itself pays nothing for this; the watchdog only reads its state.
+///
+/// The names and backtrace are taken by the loop thread itself in a handler
+/// for `signum` which the watchdog sends with pthread_kill(3); the previous
+/// disposition of `signum` is restored by stop().
+namespace ircd::ios::watchdog
+{
+	struct stall;
+
+	extern milliseconds interval;             // Sampling period
+	extern milliseconds threshold;            // Time without progress for a stall
+	extern int signum;                        // Signal used to take backtraces
+	extern uint64_t stalls;                   // Count of stalls recorded
+
+	bool for_each(const std::function<bool (const stall &)> &);
+
+	bool running() noexcept;
+	void start();
+	void stop() noexcept;
+}
+
+/// Record of one stall; the most recent are kept.
+struct ircd::ios::watchdog::stall
+{
+	uint64_t epoch {0};                       // handler::epoch which stalled
+	milliseconds duration {0};                // Time observed without progress
+	char descriptor[48] {0};                  // Name of the handler's descriptor
+	char context[16] {0};                     // Name of the running context
+	uint64_t context_id {0};                  // ID of the running context
+	uint32_t frames {0};                      // Valid frames in backtrace
+	std::array<void *, 48> backtrace {{0}};   // Of the loop thread
+};
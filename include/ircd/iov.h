@@ -0,0 +1,254 @@
+#pragma once
+#define HAVE_IRCD_IOV_H
+
+namespace ircd
+{
+	template<size_t N> struct iov;
+}
+
+/// Gather list of up to N buffers held inline.
+///
+/// The list only refers to the buffers; nothing is copied, so their memory
+/// must outlive it. It is built by appending and prefixing buffers, or by
+/// splicing other buffers in at a byte offset, which splits the buffer
+/// there. Empty buffers are not added. For writev(2), sendmsg(2) or asio the
+/// list is converted in inline storage by iov::as (i.e. to struct iovec or
+/// boost::asio::const_buffer); after a short write consume() drops what was
+/// written from the front. Exceeding N throws std::out_of_range.
+template<size_t N>
+struct ircd::iov
+{
+	template<class T> struct as;
+
+	std::array<const_buffer, N> buf;
+	size_t first {0};                            // Index of the first buffer
+	size_t last {0};                             // Index past the last buffer
+
+  private:
+	const_buffer *open(const size_t &pos, const size_t &n);
+
+  public:
+	const const_buffer *begin() const noexcept   { return buf.data() + first;                      }
+	const const_buffer *end() const noexcept     { return buf.data() + last;                       }
+	size_t size() const noexcept                 { return last - first;                            }
+	bool empty() const noexcept                  { return first == last;                           }
+	size_t bytes() const noexcept;
+
+	const const_buffer &operator[](const size_t &i) const noexcept;
+	operator vector_view<const const_buffer>() const noexcept;
+
+	iov &append(const const_buffer &);
+	iov &append(const vector_view<const const_buffer> &);
+	iov &prefix(const const_buffer &);
+	iov &splice(const size_t &offset, const vector_view<const const_buffer> &);
+	size_t consume(const size_t &bytes) noexcept;
+	void clear() noexcept;
+
+	iov(const std::initializer_list<const_buffer> &);
+	iov() = default;
+};
+
+/// The list as an array of T constructed from (pointer, size) in inline
+/// storage. This is the iovec array or the asio buffer sequence:
+///
+/// `const iov<8>::as<struct ::iovec> vec{list}; ::writev(fd, vec.data(), vec.size());`
+///
+template<size_t N>
+template<class T>
+struct ircd::iov<N>::as
+{
+	std::array<T, N> buf;
+	size_t count {0};
+
+  public:
+	const T *data() const noexcept               { return buf.data();                              }
+	size_t size() const noexcept                 { return count;                                   }
+	const T *begin() const noexcept              { return buf.data();                              }
+	const T *end() const noexcept                { return buf.data() + count;                      }
+
+	as(const iov &list) noexcept
+	:count{list.size()}
+	{
+		std::transform(list.begin(), list.end(), buf.begin(), []
+		(const const_buffer &b)
+		{
+			return T{const_cast<char *>(buffer::data(b)), buffer::size(b)};
+		});
+	}
+};
+
+template<size_t N>
+inline
+ircd::iov<N>::iov(const std::initializer_list<const_buffer> &list)
+{
+	for(const auto &b : list)
+		append(b);
+}
+
+template<size_t N>
+inline void
+ircd::iov<N>::clear()
+noexcept
+{
+	first = 0;
+	last = 0;
+}
+
+/// Removes bytes from the front of the list; returns the bytes removed.
+template<size_t N>
+inline size_t
+ircd::iov<N>::consume(const size_t &bytes)
+noexcept
+{
+	size_t ret(0);
+	while(first < last && ret < bytes)
+	{
+		auto &b(buf[first]);
+		ret += buffer::consume(b, std::min(buffer::size(b), bytes - ret));
+		if(!buffer::empty(b))
+			break;
+
+		++first;
+	}
+
+	if(first == last)
+		clear();
+
+	return ret;
+}
+
+/// Inserts the buffers at the offset in bytes from the front of the list.
+/// A buffer spanning the offset is split in two around them.
+template<size_t N>
+inline ircd::iov<N> &
+ircd::iov<N>::splice(const size_t &offset,
+                     const vector_view<const const_buffer> &bufs)
+{
+	size_t i(0), rem(offset);
+	while(i < size() && rem >= buffer::size((*this)[i]))
+		rem -= buffer::size((*this)[i++]);
+
+	if(unlikely(i == size() && rem))
+		throw std::out_of_range
+		{
+			"iov::splice offset past the end"
+		};
+
+	const size_t n
+	{
+		size_t(std::count_if(std::begin(bufs), std::end(bufs), [](const auto &b)
+		{
+			return !buffer::empty(b);
+		}))
+	};
+
+	const const_buffer whole
+	{
+		rem? (*this)[i]: const_buffer{}
+	};
+
+	auto *at
+	{
+		rem? open(i + 1, n + 1): open(i, n)
+	};
+
+	for(const auto &b : bufs)
+		if(!buffer::empty(b))
+			*at++ = b;
+
+	if(rem)
+	{
+		buf[first + i] = const_buffer{buffer::data(whole), rem};
+		*at = const_buffer{buffer::data(whole) + rem, buffer::size(whole) - rem};
+	}
+
+	return *this;
+}
+
+template<size_t N>
+inline ircd::iov<N> &
+ircd::iov<N>::prefix(const const_buffer &b)
+{
+	if(unlikely(buffer::empty(b)))
+		return *this;
+
+	if(first)
+		buf[--first] = b;
+	else
+		*open(0, 1) = b;
+
+	return *this;
+}
+
+template<size_t N>
+inline ircd::iov<N> &
+ircd::iov<N>::append(const vector_view<const const_buffer> &bufs)
+{
+	return splice(bytes(), bufs);
+}
+
+template<size_t N>
+inline ircd::iov<N> &
+ircd::iov<N>::append(const const_buffer &b)
+{
+	if(likely(!buffer::empty(b)))
+		*open(size(), 1) = b;
+
+	return *this;
+}
+
+/// Makes room for n buffers at pos, moving the list to the front of the
+/// storage when the back is full.
+template<size_t N>
+inline ircd::const_buffer *
+ircd::iov<N>::open(const size_t &pos,
+                   const size_t &n)
+{
+	assert(pos <= size());
+	if(unlikely(size() + n > N))
+		throw std::out_of_range
+		{
+			"iov capacity exceeded"
+		};
+
+	if(last + n > N)
+	{
+		std::move(buf.begin() + first, buf.begin() + last, buf.begin());
+		last -= first;
+		first = 0;
+	}
+
+	auto *const ret(buf.data() + first + pos);
+	std::move_backward(ret, buf.data() + last, buf.data() + last + n);
+	last += n;
+	return ret;
+}
+
+template<size_t N>
+inline ircd::iov<N>::operator
+vector_view<const const_buffer>()
+const noexcept
+{
+	return {begin(), end()};
+}
+
+template<size_t N>
+inline const ircd::const_buffer &
+ircd::iov<N>::operator[](const size_t &i)
+const noexcept
+{
+	assert(i < size());
+	return buf[first + i];
+}
+
+template<size_t N>
+inline size_t
+ircd::iov<N>::bytes()
+const noexcept
+{
+	return std::accumulate(begin(), end(), size_t(0), []
+	(const size_t &ret, const const_buffer &b)
+	{
+		return ret + buffer::size(b);
+	});
+}
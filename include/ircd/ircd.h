@@ -29,6 +29,7 @@
 #include "string_view.h"
 #include "vector_view.h"
 #include "buffer/buffer.h"
+#include "iov.h"
 #include "allocator/allocator.h"
 #include "util/util.h"
 #include "exception.h"
@@ -42,6 +43,8 @@
 #include "prof/prof.h"
 #include "ios/ios.h"
 #include "ctx/ctx.h"
+#include "batch.h"
+#include "fs.h"
 
 namespace ircd
 {
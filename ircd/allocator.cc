@@ -1,5 +1,7 @@
+#include <RB_INC_EXECINFO_H
 #include <RB_INC_SYS_RESOURCE_H
 #include <RB_INC_SYS_MMAN_H
+#include <RB_INC_CXXABI_H
 
 // Uncomment or -D this #define to enable our own crude but simple ability to
 // profile dynamic memory usage. Global `new` and `delete` will be captured
@@ -63,10 +65,11 @@ ircd::allocator::allocate(const size_t alignment,
 	assert(ret != nullptr);
 	assert(uintptr_t(ret) % alignment == 0);
 
-	// if(likely(info::thp_size))
-	if(true)
+	if(unlikely(hugepage::thp && alignment >= hugepage::size))
 		advise_hugepage(ret, alignment, size);
 
+	attribution::charge(size);
+
 	#ifdef RB_PROF_ALLOC
 	auto &this_thread(ircd::allocator::profile::this_thread);
 	this_thread.alloc_bytes += size;
@@ -84,14 +87,17 @@ ircd::allocator::advise_hugepage(void *const &ptr,
 #if defined(MADV_HUGEPAGE)
 try
 {
-	// if(likely(alignment < info::thp_size))
-	// 	return;
+	if(unlikely(!hugepage::size))
+		return;
+
+	if(likely(alignment < hugepage::size))
+		return;
 
-	// if(likely(alignment % size_t(info::thp_size) != 0))
-	// 	return;
+	if(likely(alignment % hugepage::size != 0))
+		return;
 
-	// if(!has(info::thp_enable, "[madvise]"))
-	// 	return;
+	if(likely(size < hugepage::size))
+		return;
 
 	// sys::call(::madvise, ptr, size, MADV_HUGEPAGE);
 	madvise(ptr, size, MADV_HUGEPAGE);
@@ -150,11 +156,11 @@ void
 ircd::allocator::state::deallocate(const uint &pos,
                                    const size_type &n)
 {
-	for(size_t i(0); i < n; ++i)
-	{
-		assert(test(pos + i));
-		btc(pos + i);
-	}
+	assert(test(pos, n) || n == 0);
+	if(likely(n == 1))
+		btc(pos);
+	else
+		btc(pos, n);
 
 	last = pos;
 }
@@ -179,201 +185,2126 @@ ircd::allocator::state::allocate(std::nothrow_t,
                                  const size_type &n,
                                  const uint &hint)
 {
+	// Single object with a clear bit left in the word at last: taken here
+	// without calling out to the search.
+	if(likely(n == 1 && last < size))
+	{
+		const word_t free(~avail[byte(last)] & (~word_t(0) << bit(last)));
+		const uint pos(byte(last) * word_bits + __builtin_ctzll(free | (word_t(1) << (word_bits - 1))));
+		if(likely(free && pos < size))
+		{
+			bts(pos);
+			last = pos + 1;
+			return pos;
+		}
+	}
+
 	const auto next(this->next(n));
 	if(unlikely(next >= size))         // No block of n was found anywhere (next is past-the-end)
 		return next;
 
-	for(size_t i(0); i < n; ++i)
-	{
-		assert(!test(next + i));
-		bts(next + i);
-	}
+	assert(find(true, next, next + n) == next + n);
+	if(likely(n == 1))
+		bts(next);
+	else
+		bts(next, n);
 
 	last = next + n;
 	return next;
 }
 
+/// Searches from last to the end, then from the start for runs which end
+/// before the first search began.
 uint
 ircd::allocator::state::next(const size_t &n)
 const
 {
-	uint ret(last), rem(n);
-	for(; ret < size && rem; ++ret)
-		if(test(ret))
-			rem = n;
-		else
-			--rem;
+	if(unlikely(!n))
+		return std::min(last, size);
 
-	if(likely(!rem))
-		return ret - n;
+	// Single objects (i.e. every node container) only need the first clear
+	// bit: ctz of the first word which isn't full.
+	if(likely(n == 1))
+	{
+		const uint pos(std::min(last, size));
+		const auto ret(find(false, pos, size));
+		if(likely(ret < size))
+			return ret;
 
-	for(ret = 0, rem = n; ret < last && rem; ++ret)
-		if(test(ret))
-			rem = n;
-		else
-			--rem;
+		const auto wrap(find(false, 0, pos));
+		return wrap < pos? wrap: size;
+	}
 
-	if(unlikely(rem))                  // The allocator should throw std::bad_alloc if !rem
-		return size;
+	const auto ret
+	{
+		next(n, last, size)
+	};
+
+	if(likely(ret < size))
+		return ret;
+
+	const uint end
+	{
+		uint(std::min(last + n - 1, size))
+	};
+
+	const auto wrap
+	{
+		next(n, 0, end)
+	};
 
-	return ret - n;
+	return wrap < end? wrap: size;         // The allocator should throw std::bad_alloc
 }
 
-bool
-ircd::allocator::state::available(const size_t &n)
+/// First run of n clear bits within [pos, end); end if none. The free bits
+/// are examined a word at a time: runs within a word are found by shifting
+/// the word over itself, and runs spanning words by carrying the length of
+/// the free bits at the top of the previous word.
+[[gnu::hot]]
+uint
+ircd::allocator::state::next(const size_t &n,
+                             const uint &pos,
+                             const uint &end)
 const
 {
-	return this->next(n) < size;
-}
+	if(unlikely(pos + n > end))
+		return end;
 
-//
-// allocator::scope
-//
+	size_t carry(0);
+	const uint first_word(byte(pos)), last_word(byte(end - 1));
+	for(uint i(first_word); i <= last_word; ++i)
+	{
+		word_t free(~avail[i]);
+		if(i == first_word)
+			free &= ~word_t(0) << bit(pos);
+
+		if(i == last_word && bit(end))
+			free &= mask(end) - 1;
+
+		// Run continued from the previous word(s).
+		if(carry)
+		{
+			const size_t low
+			{
+				~free? size_t(__builtin_ctzll(~free)): size_t(word_bits)
+			};
+
+			if(carry + low >= n)
+				return i * word_bits - carry;
+
+			if(low == word_bits)
+			{
+				carry += word_bits;
+				continue;
+			}
+		}
+
+		// Run within this word; bit k of x is set when bits [k, k + n) are.
+		if(n <= word_bits)
+		{
+			word_t x(free);
+			for(size_t len(1); len < n && x;)
+			{
+				const size_t shift(std::min(len, n - len));
+				x &= x >> shift;
+				len += shift;
+			}
+
+			if(x)
+				return i * word_bits + __builtin_ctzll(x);
+		}
+
+		// Run starting at the top of this word.
+		carry = ~free? __builtin_clzll(~free): word_bits;
+		if(carry >= n)
+			return (i + 1) * word_bits - carry;
+	}
 
-decltype(ircd::allocator::scope::current)
-ircd::allocator::scope::current;
+	return end;
+}
 
-ircd::allocator::scope::scope(alloc_closure ac,
-                              realloc_closure rc,
-                              free_closure fc)
-:theirs
+/// Position of the first bit with the value val within [pos, end); end if
+/// none.
+[[gnu::hot]]
+uint
+ircd::allocator::state::find(const bool &val,
+                             const uint &pos,
+                             const uint &end)
+const
 {
-	current
+	if(unlikely(pos >= end))
+		return end;
+
+	const word_t flip
+	{
+		val? word_t(0): ~word_t(0)
+	};
+
+	uint i(byte(pos));
+	const uint last_word(byte(end - 1));
+	word_t w((avail[i] ^ flip) & (~word_t(0) << bit(pos)));
+	while(!w && i < last_word)
+	{
+		#if defined(__AVX2__)
+		// Skip four words at once while none of them have the value.
+		const __m256i ones(_mm256_set1_epi64x(-1));
+		const __m256i fl(_mm256_set1_epi64x(flip));
+		for(; i + 4 < last_word; i += 4)
+		{
+			const __m256i v
+			{
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(avail + i + 1))
+			};
+
+			if(!_mm256_testz_si256(_mm256_xor_si256(v, fl), ones))
+				break;
+		}
+		#endif
+
+		w = avail[++i] ^ flip;
+	}
+
+	if(!w)
+		return end;
+
+	const uint ret
+	{
+		i * word_bits + __builtin_ctzll(w)
+	};
+
+	return std::min(ret, end);
 }
-,user_alloc
+
+/// Whether all n bits from pos are set.
+bool
+ircd::allocator::state::test(const uint &pos,
+                             const size_t &n)
+const
 {
-	std::move(ac)
+	return find(false, pos, pos + n) == pos + n;
 }
-,user_realloc
+
+void
+ircd::allocator::state::bts(const uint &pos,
+                            const size_t &n)
 {
-	std::move(rc)
+	for(size_t i(pos), rem(n); rem;)
+	{
+		const size_t len(std::min(rem, size_t(word_bits - bit(i))));
+		const word_t m(len == word_bits? ~word_t(0): ((word_t(1) << len) - 1) << bit(i));
+		avail[byte(i)] |= m;
+		i += len;
+		rem -= len;
+	}
 }
-,user_free
+
+void
+ircd::allocator::state::btc(const uint &pos,
+                            const size_t &n)
 {
-	std::move(fc)
+	for(size_t i(pos), rem(n); rem;)
+	{
+		const size_t len(std::min(rem, size_t(word_bits - bit(i))));
+		const word_t m(len == word_bits? ~word_t(0): ((word_t(1) << len) - 1) << bit(i));
+		avail[byte(i)] &= ~m;
+		i += len;
+		rem -= len;
+	}
 }
+
+/// Number of allocated slots.
+size_t
+ircd::allocator::state::used()
+const
 {
-	// If an allocator::scope instance already exists somewhere
-	// up the stack, *current will already be set. We only install
-	// our global hook handlers at the first instance ctor and
-	// uninstall it after that first instance dtors.
-	if(!current)
-		hook_init();
+	size_t ret(0);
+	const uint words(size / word_bits);
+	for(uint i(0); i < words; ++i)
+		ret += __builtin_popcountll(avail[i]);
 
-	current = this;
+	if(bit(size))
+		ret += __builtin_popcountll(avail[words] & (mask(size) - 1));
+
+	return ret;
 }
 
-ircd::allocator::scope::~scope()
-noexcept
+bool
+ircd::allocator::state::available(const size_t &n)
+const
 {
-	assert(current);
-	current = theirs;
-
-	// Reinstall the pre-existing hooks after our last scope instance
-	// has destructed (the first to have constructed). We know this when
-	// current becomes null.
-	if(!current)
-		hook_fini();
+	return this->next(n) < size;
 }
 
+//
+// allocator::atomic_state
+//
+
+decltype(ircd::allocator::atomic_state::cursor)
+thread_local
+ircd::allocator::atomic_state::cursor
+{
+	uint(-1)
+};
+
 void
-__attribute__((weak))
-ircd::allocator::scope::hook_init()
+ircd::allocator::atomic_state::deallocate(const uint &pos,
+                                          const size_type &n)
 noexcept
 {
+	if(unlikely(!n))
+		return;
+
+	assert(n <= word_bits);
+	assert(state::bit(pos) + n <= word_bits);
+	const word_t mask
+	{
+		(n < word_bits? (word_t(1) << n) - 1: ~word_t(0)) << state::bit(pos)
+	};
+
+	auto &word(avail[state::byte(pos)]);
+	assert((word.load(std::memory_order_relaxed) & mask) == mask);
+	word.fetch_and(~mask, std::memory_order_release);
 }
 
-void
-__attribute__((weak))
-ircd::allocator::scope::hook_fini()
-noexcept
+uint
+ircd::allocator::atomic_state::allocate(const size_type &n)
+{
+	const auto ret
+	{
+		allocate(std::nothrow, n)
+	};
+
+	if(unlikely(ret >= size))
+		throw std::bad_alloc();
+
+	return ret;
+}
+
+uint
+ircd::allocator::atomic_state::allocate(std::nothrow_t,
+                                        const size_type &n)
+{
+	if(unlikely(!n || n > word_bits))
+		return size;
+
+	// Threads start spread over the bitmap by their id.
+	if(unlikely(cursor == uint(-1)))
+		cursor = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+	const word_t run
+	{
+		n < word_bits? (word_t(1) << n) - 1: ~word_t(0)
+	};
+
+	const size_t words(this->words());
+	const size_t start(cursor % words);
+	for(size_t i(0); i < words; ++i)
+	{
+		const uint w((start + i) % words);
+		const uint bits(std::min(size - w * word_bits, size_t(word_bits)));
+		if(bits < n)
+			continue;
+
+		const word_t valid
+		{
+			bits < word_bits? (word_t(1) << bits) - 1: ~word_t(0)
+		};
+
+		word_t cur(avail[w].load(std::memory_order_relaxed));
+		while(~cur & valid)
+		{
+			// Positions where n free bits begin; by doubling the run length.
+			word_t free(~cur & valid);
+			for(uint len(1); len < n && free; )
+			{
+				const uint shift(std::min(len, uint(n) - len));
+				free &= free >> shift;
+				len += shift;
+			}
+
+			if(!free)
+				break;
+
+			const uint off(__builtin_ctzll(free));
+			const word_t mask(run << off);
+			const word_t old(avail[w].fetch_or(mask, std::memory_order_acquire));
+			if(likely(!(old & mask)))
+			{
+				cursor = w;
+				return w * word_bits + off;
+			}
+
+			// Some of the run was taken meanwhile; release what this set.
+			avail[w].fetch_and(~(mask & ~old), std::memory_order_relaxed);
+			cur = old;
+		}
+	}
+
+	return size;
+}
+
+bool
+ircd::allocator::atomic_state::test(const uint &pos)
+const
+{
+	return avail[state::byte(pos)].load(std::memory_order_relaxed) & state::mask(pos);
+}
+
+size_t
+ircd::allocator::atomic_state::used()
+const
 {
+	size_t ret(0);
+	for(size_t i(0); i < words(); ++i)
+		ret += __builtin_popcountll(avail[i].load(std::memory_order_relaxed));
+
+	return ret;
 }
 
 //
-// allocator::profile
+// allocator::twolevel_site
 //
 
-thread_local ircd::allocator::profile
-ircd::allocator::profile::this_thread
-{};
+namespace ircd::allocator
+{
+	static std::string demangle(const std::type_info &);
 
-ircd::allocator::profile
-ircd::allocator::operator-(const profile &a,
-                           const profile &b)
+	static std::mutex twolevel_list_mutex;
+	static twolevel_site *twolevel_list;
+}
+
+bool
+ircd::allocator::for_each(const std::function<bool (const twolevel_site &)> &closure)
 {
-	profile ret(a);
-	ret -= b;
-	return ret;
+	const std::lock_guard lock{twolevel_list_mutex};
+	for(const auto *site(twolevel_list); site; site = site->next)
+		if(!closure(*site))
+			return false;
+
+	return true;
 }
 
-ircd::allocator::profile
-ircd::allocator::operator+(const profile &a,
-                           const profile &b)
+ircd::allocator::twolevel_site::twolevel_site(const std::type_info &type,
+                                              const size_t &l0_size)
+:type_name{demangle(type)}
+,name{type_name}
+,l0_size{l0_size}
 {
-	profile ret(a);
-	ret += b;
-	return ret;
+	const std::lock_guard lock{twolevel_list_mutex};
+	next = twolevel_list;
+	twolevel_list = this;
 }
 
-ircd::allocator::profile &
-ircd::allocator::operator-=(profile &a,
-                            const profile &b)
+ircd::allocator::twolevel_site::twolevel_site(const string_view &name,
+                                              const size_t &l0_size)
+:name{name}
+,l0_size{l0_size}
 {
-	a.alloc_count -= b.alloc_count;
-	a.free_count -= b.free_count;
-	a.alloc_bytes -= b.alloc_bytes;
-	a.free_bytes -= b.free_bytes;
-	return a;
+	const std::lock_guard lock{twolevel_list_mutex};
+	next = twolevel_list;
+	twolevel_list = this;
 }
 
-ircd::allocator::profile &
-ircd::allocator::operator+=(profile &a,
-                            const profile &b)
+ircd::allocator::twolevel_site::~twolevel_site()
+noexcept
 {
-	a.alloc_count += b.alloc_count;
-	a.free_count += b.free_count;
-	a.alloc_bytes += b.alloc_bytes;
-	a.free_bytes += b.free_bytes;
-	return a;
+	const std::lock_guard lock{twolevel_list_mutex};
+	for(auto **it(&twolevel_list); *it; it = &(*it)->next)
+		if(*it == this)
+		{
+			*it = next;
+			break;
+		}
+}
+
+/// The mangled name is kept when the ABI can't demangle it.
+std::string
+ircd::allocator::demangle(const std::type_info &type)
+{
+	#if defined(HAVE_CXXABI_H)
+	int status(0);
+	const std::unique_ptr<char, decltype(&std::free)> ret
+	{
+		abi::__cxa_demangle(type.name(), nullptr, nullptr, &status), std::free
+	};
+
+	if(likely(ret && status == 0))
+		return ret.get();
+	#endif
+
+	return type.name();
 }
 
 //
-// Developer profiling
+// allocator::hugepage
 //
 
-#ifdef RB_PROF_ALLOC // --------------------------------------------------
+namespace ircd::allocator::hugepage
+{
+	static size_t read_size() noexcept;
+	static bool read_thp() noexcept;
+	static char *map(const size_t &);
+	static size_t unwant(const char *) noexcept;
+	static bool region(const size_t &len) noexcept;
+
+	static std::mutex mutex;
+	static std::vector<std::pair<char *, size_t>> regions;
+	static std::map<size_t, std::vector<char *>> slots;
+	static std::map<const char *, size_t> wanted;     // Size asked for each allocation
+}
 
-void *
-__attribute__((alloc_size(1), malloc, returns_nonnull))
-operator new(const size_t size)
+decltype(ircd::allocator::hugepage::size)
+ircd::allocator::hugepage::size
 {
-	void *const &ptr(::malloc(size));
-	if(unlikely(!ptr))
-		throw std::bad_alloc();
+	read_size()
+};
 
-	auto &this_thread(ircd::allocator::profile::this_thread);
-	this_thread.alloc_bytes += size;
-	this_thread.alloc_count++;
+decltype(ircd::allocator::hugepage::thp)
+ircd::allocator::hugepage::thp
+{
+	read_thp()
+};
 
-	return ptr;
+decltype(ircd::allocator::hugepage::hugetlb)
+ircd::allocator::hugepage::hugetlb;
+
+decltype(ircd::allocator::hugepage::requested)
+ircd::allocator::hugepage::requested;
+
+decltype(ircd::allocator::hugepage::mapped)
+ircd::allocator::hugepage::mapped;
+
+decltype(ircd::allocator::hugepage::padded)
+ircd::allocator::hugepage::padded;
+
+ircd::mutable_buffer
+ircd::allocator::hugepage::allocate(const size_t &want)
+{
+	const size_t page(4_KiB);
+	const size_t huge(size?: 2_MiB);
+	const size_t slot(pad_to(want?: 1, page));
+	if(region(slot))
+	{
+		const size_t len(pad_to(want, huge));
+		char *const ret(map(len));
+		const std::lock_guard lock{mutex};
+		regions.emplace_back(ret, len);
+		wanted.emplace(ret, want);
+		requested.fetch_add(want, std::memory_order_relaxed);
+		padded.fetch_add(len, std::memory_order_relaxed);
+		return mutable_buffer{ret, len};
+	}
+
+	const size_t len(slot);
+	const std::lock_guard lock{mutex};
+	auto &free(slots[len]);
+	if(free.empty())
+	{
+		char *const region(map(huge));
+		regions.emplace_back(region, huge);
+		for(size_t off(huge / len * len); off; off -= len)
+			free.emplace_back(region + off - len);
+	}
+
+	char *const ret(free.back());
+	wanted.emplace(ret, want);
+	free.pop_back();
+	requested.fetch_add(want, std::memory_order_relaxed);
+	padded.fetch_add(len, std::memory_order_relaxed);
+	return mutable_buffer{ret, len};
 }
 
 void
-operator delete(void *const ptr)
+ircd::allocator::hugepage::deallocate(const mutable_buffer &buf)
 noexcept
 {
-	::free(ptr);
+	const size_t page(4_KiB);
+	const size_t huge(size?: 2_MiB);
+	if(!data(buf))
+		return;
+
+	// Slots are given out at their padded size, so this is the same test
+	// allocate() made.
+	if(region(ircd::size(buf)))
+	{
+		const size_t len(pad_to(ircd::size(buf), huge));
+		{
+			const std::lock_guard lock{mutex};
+			const auto it(std::find(begin(regions), end(regions), std::make_pair(data(buf), len)));
+			assert(it != end(regions));
+			if(it != end(regions))
+				regions.erase(it);
+
+			requested.fetch_sub(unwant(data(buf)), std::memory_order_relaxed);
+		}
+
+		::munmap(data(buf), len);
+		padded.fetch_sub(len, std::memory_order_relaxed);
+		mapped.fetch_sub(len, std::memory_order_relaxed);
+		return;
+	}
 
-	auto &this_thread(ircd::allocator::profile::this_thread);
-	this_thread.free_count++;
+	const size_t len(pad_to(ircd::size(buf)?: 1, page));
+	const std::lock_guard lock{mutex};
+	slots[len].emplace_back(data(buf));
+	requested.fetch_sub(unwant(data(buf)), std::memory_order_relaxed);
+	padded.fetch_sub(len, std::memory_order_relaxed);
 }
 
-void
-operator delete(void *const ptr,
-                const size_t size)
+/// Whether an allocation padded to len bytes gets its own region; slots are
+/// always smaller than half a huge page.
+bool
+ircd::allocator::hugepage::region(const size_t &len)
+noexcept
+{
+	const size_t huge(size?: 2_MiB);
+	return len >= huge / 2;
+}
+
+/// Forgets the size asked for the allocation at ptr and returns it; called
+/// with the mutex held.
+size_t
+ircd::allocator::hugepage::unwant(const char *const ptr)
 noexcept
 {
+	const auto it(wanted.find(ptr));
+	assert(it != end(wanted));
+	if(unlikely(it == end(wanted)))
+		return 0;
+
+	const size_t ret(it->second);
+	wanted.erase(it);
+	return ret;
+}
+
+/// Maps a region aligned to the huge page size; len is a multiple of it.
+/// The caller records it in regions.
+char *
+ircd::allocator::hugepage::map(const size_t &len)
+{
+	const size_t huge(size?: 2_MiB);
+	char *ret(nullptr);
+
+	#if defined(MAP_HUGETLB)
+	if(hugetlb)
+	{
+		void *const ptr
+		{
+			::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)
+		};
+
+		if(ptr != MAP_FAILED)
+			ret = static_cast<char *>(ptr);
+	}
+	#endif
+
+	// Over-map by a huge page and trim either end for alignment.
+	if(!ret)
+	{
+		void *const ptr
+		{
+			::mmap(nullptr, len + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+		};
+
+		if(unlikely(ptr == MAP_FAILED))
+			throw std::bad_alloc{};
+
+		char *const base(static_cast<char *>(ptr));
+		ret = reinterpret_cast<char *>(pad_to(uintptr_t(base), huge));
+		if(ret > base)
+			::munmap(base, ret - base);
+
+		if(base + len + huge > ret + len)
+			::munmap(ret + len, base + len + huge - (ret + len));
+
+		#if defined(MADV_HUGEPAGE)
+		if(thp)
+			::madvise(ret, len, MADV_HUGEPAGE);
+		#endif
+	}
+
+	mapped.fetch_add(len, std::memory_order_relaxed);
+	return ret;
+}
+
+/// Sums the huge pages backing our regions from /proc/self/smaps.
+size_t
+ircd::allocator::hugepage::backed()
+{
+	std::vector<std::pair<char *, size_t>> ours;
+	{
+		const std::lock_guard lock{mutex};
+		ours = regions;
+	}
+
+	size_t ret(0);
+	bool in(false);
+	std::ifstream smaps("/proc/self/smaps");
+	for(std::string line; std::getline(smaps, line);)
+	{
+		uintptr_t start, stop;
+		if(std::sscanf(line.c_str(), "%lx-%lx ", &start, &stop) == 2)
+		{
+			in = std::any_of(begin(ours), end(ours), [&start, &stop](const auto &region)
+			{
+				const auto base(uintptr_t(region.first));
+				return start < base + region.second && stop > base;
+			});
+
+			continue;
+		}
+
+		size_t kib;
+		if(in && (std::sscanf(line.c_str(), "AnonHugePages: %zu kB", &kib) == 1 ||
+		          std::sscanf(line.c_str(), "Private_Hugetlb: %zu kB", &kib) == 1 ||
+		          std::sscanf(line.c_str(), "Shared_Hugetlb: %zu kB", &kib) == 1))
+			ret += kib * 1024;
+	}
+
+	return ret;
+}
+
+size_t
+ircd::allocator::hugepage::read_size()
+noexcept
+{
+	size_t ret(0);
+	std::ifstream file("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+	file >> ret;
+	return ret;
+}
+
+bool
+ircd::allocator::hugepage::read_thp()
+noexcept
+{
+	std::string val;
+	std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+	std::getline(file, val);
+	return val.find("[always]") != val.npos || val.find("[madvise]") != val.npos;
+}
+
+//
+// allocator::slab_pool
+//
+
+namespace ircd::allocator
+{
+	static std::mutex slab_list_mutex;
+	static slab_pool *slab_list;
+	static slab_pool::caches *slab_caches;
+}
+
+struct ircd::allocator::slab_pool::magazine
+{
+	size_t count {0};
+	std::array<void *, magazine_size> obj;
+};
+
+/// A thread's magazines for one pool; returned to the depot at thread exit.
+struct ircd::allocator::slab_pool::cache
+{
+	slab_pool *pool {nullptr};
+	magazine *loaded {nullptr};
+	magazine *previous {nullptr};
+
+	cache() = default;
+	cache(cache &&o) noexcept
+	:pool{std::exchange(o.pool, nullptr)}
+	,loaded{std::exchange(o.loaded, nullptr)}
+	,previous{std::exchange(o.previous, nullptr)}
+	{}
+
+	~cache() noexcept
+	{
+		if(!pool)
+			return;
+
+		const std::lock_guard lock{pool->mutex};
+		for(auto *const mag : {loaded, previous})
+			if(mag)
+				(mag->count? pool->full: pool->empty).emplace_back(mag);
+	}
+};
+
+/// A thread's caches of every pool, indexed by pool id. Registered so that a
+/// pool being destroyed can take its magazines back from threads which
+/// outlive it; the list lock is held while they are returned at thread exit
+/// so no pool can be destroyed meanwhile.
+struct ircd::allocator::slab_pool::caches
+{
+	caches *next {nullptr};
+	std::vector<slab_pool::cache> slot;
+
+	caches() noexcept
+	{
+		const std::lock_guard lock{slab_list_mutex};
+		next = slab_caches;
+		slab_caches = this;
+	}
+
+	~caches() noexcept
+	{
+		const std::lock_guard lock{slab_list_mutex};
+		for(auto **it(&slab_caches); *it; it = &(*it)->next)
+			if(*it == this)
+			{
+				*it = next;
+				break;
+			}
+
+		slot.clear();
+	}
+};
+
+bool
+ircd::allocator::for_each(const std::function<bool (const slab_pool &)> &closure)
+{
+	const std::lock_guard lock{slab_list_mutex};
+	for(const auto *pool(slab_list); pool; pool = pool->next)
+		if(!closure(*pool))
+			return false;
+
+	return true;
+}
+
+ircd::allocator::slab_pool::~slab_pool()
+noexcept
+{
+	{
+		const std::lock_guard lock{slab_list_mutex};
+		for(auto **it(&slab_list); *it; it = &(*it)->next)
+			if(*it == this)
+			{
+				*it = next;
+				break;
+			}
+
+		// Detach from the threads still running; their magazines only hold
+		// objects of the slabs freed below.
+		for(auto *t(slab_caches); t; t = t->next)
+			if(id < t->slot.size() && t->slot[id].pool == this)
+			{
+				auto &cache(t->slot[id]);
+				delete cache.loaded;
+				delete cache.previous;
+				cache.loaded = nullptr;
+				cache.previous = nullptr;
+				cache.pool = nullptr;
+			}
+	}
+
+	for(auto *const mag : full)
+		delete mag;
+
+	for(auto *const mag : empty)
+		delete mag;
+
+	for(auto *const slab : slabs)
+		std::free(slab);
+}
+
+void *
+ircd::allocator::slab_pool::allocate()
+{
+	auto &cache(local(*this));
+	if(unlikely(!cache.loaded || !cache.loaded->count))
+	{
+		if(cache.previous && cache.previous->count)
+			std::swap(cache.loaded, cache.previous);
+		else
+			cache.loaded = exchange(cache.loaded, true);
+	}
+
+	assert(cache.loaded && cache.loaded->count);
+	void *const ret
+	{
+		cache.loaded->obj[--cache.loaded->count]
+	};
+
+	const auto now
+	{
+		live.fetch_add(1, std::memory_order_relaxed) + 1
+	};
+
+	if(unlikely(now > peak.load(std::memory_order_relaxed)))
+		peak.store(now, std::memory_order_relaxed);
+
+	allocs.fetch_add(1, std::memory_order_relaxed);
+	return ret;
+}
+
+void
+ircd::allocator::slab_pool::deallocate(void *const ptr)
+noexcept try
+{
+	if(unlikely(!ptr))
+		return;
+
+	auto &cache(local(*this));
+	if(unlikely(!cache.loaded || cache.loaded->count >= magazine_size))
+	{
+		if(cache.previous && cache.previous->count < magazine_size)
+			std::swap(cache.loaded, cache.previous);
+		else
+			cache.loaded = exchange(cache.loaded, false);
+	}
+
+	assert(cache.loaded && cache.loaded->count < magazine_size);
+	cache.loaded->obj[cache.loaded->count++] = ptr;
+	live.fetch_sub(1, std::memory_order_relaxed);
+}
+catch(...)
+{
+	// Only a new magazine can fail; the object is lost to the pool.
+	live.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/// Gives the magazine to the depot and takes one back which is full for
+/// allocating or empty for freeing.
+ircd::allocator::slab_pool::magazine *
+ircd::allocator::slab_pool::exchange(magazine *const mag,
+                                     const bool &want_full)
+{
+	depot.fetch_add(1, std::memory_order_relaxed);
+	{
+		const std::lock_guard lock{mutex};
+		if(mag)
+			(mag->count? full: empty).emplace_back(mag);
+
+		auto &list(want_full? full: empty);
+		if(!list.empty())
+		{
+			auto *const ret(list.back());
+			list.pop_back();
+			return ret;
+		}
+	}
+
+	return want_full? grow(): new magazine;
+}
+
+/// Allocates a slab of objects filling a new magazine.
+ircd::allocator::slab_pool::magazine *
+ircd::allocator::slab_pool::grow()
+{
+	auto mag
+	{
+		std::make_unique<magazine>()
+	};
+
+	char *const slab
+	{
+		allocator::allocate(align, size * magazine_size)
+	};
+
+	{
+		const std::lock_guard lock{mutex};
+		slabs.emplace_back(slab);
+	}
+
+	for(size_t i(0); i < magazine_size; ++i)
+		mag->obj[mag->count++] = slab + (magazine_size - i - 1) * size;
+
+	grows.fetch_add(1, std::memory_order_relaxed);
+	return mag.release();
+}
+
+ircd::allocator::slab_pool::cache &
+ircd::allocator::slab_pool::local(slab_pool &pool)
+{
+	thread_local caches caches;
+	if(likely(pool.id < caches.slot.size() && caches.slot[pool.id].pool == &pool))
+		return caches.slot[pool.id];
+
+	// First use of the pool on this thread (or at all); the list lock orders
+	// this against a pool detaching from the cache.
+	const std::lock_guard lock{slab_list_mutex};
+	if(unlikely(pool.id == size_t(-1)))
+		pool.enlist();
+
+	if(pool.id >= caches.slot.size())
+		caches.slot.resize(pool.id + 1);
+
+	auto &ret(caches.slot[pool.id]);
+	assert(!ret.pool && !ret.loaded && !ret.previous);
+	ret.pool = &pool;
+	return ret;
+}
+
+/// Registers the pool with the lowest id no other pool has; called with the
+/// list locked at first use.
+void
+ircd::allocator::slab_pool::enlist()
+noexcept
+{
+	if(type && !name)
+		name = type->name();
+
+	for(id = 0;; ++id)
+	{
+		const slab_pool *it(slab_list);
+		for(; it && it->id != id; it = it->next);
+		if(!it)
+			break;
+	}
+
+	next = slab_list;
+	slab_list = this;
+}
+
+//
+// allocator::arena
+//
+
+struct ircd::allocator::arena::block
+{
+	block *prev {nullptr};
+	size_t size {0};                             // Of data
+	alignas(std::max_align_t) char data[0];
+};
+
+ircd::allocator::arena::arena(const mutable_buffer &initial,
+                              const size_t &block_size)
+:initial{initial}
+,pos{data(initial)}
+,end{data(initial) + size(initial)}
+,block_size{std::max(block_size, sizeof(block) + alignof(std::max_align_t))}
+{
+}
+
+ircd::allocator::arena::~arena()
+noexcept
+{
+	reset();
+	std::free(table);
+}
+
+void
+ircd::allocator::arena::reset()
+noexcept
+{
+	mark start;
+	start.pos = data(initial);
+	rewind(start);
+}
+
+void
+ircd::allocator::arena::rewind(const mark &m)
+noexcept
+{
+	while(head != m.head)
+	{
+		assert(head);
+		assert(blocks && table[blocks - 1] == head);
+		auto *const prev(head->prev);
+		std::free(head);
+		head = prev;
+		--blocks;
+	}
+
+	pos = m.pos;
+	end = head? head->data + head->size: data(initial) + size(initial);
+	allocated = m.allocated;
+	assert(pos >= (head? head->data: data(initial)) && pos <= end);
+}
+
+void *
+ircd::allocator::arena::allocate(const size_t &size,
+                                 const size_t &align)
+{
+	assert(align && (align & (align - 1)) == 0);
+	char *ret
+	{
+		reinterpret_cast<char *>(pad_to(uintptr_t(pos), align))
+	};
+
+	if(unlikely(!pos || ret + size > end))
+		ret = grow(size, align);
+
+	pos = ret + size;
+	allocated += size;
+	return ret;
+}
+
+/// Chains a block with room for the allocation; the new block is the larger
+/// of the allocation and the next geometric size.
+char *
+ircd::allocator::arena::grow(const size_t &size,
+                             const size_t &align)
+{
+	const size_t want
+	{
+		std::max(size + align, block_size - sizeof(block))
+	};
+
+	if(unlikely(blocks == table_size))
+	{
+		const size_t count
+		{
+			std::max(table_size * 2, 8UL)
+		};
+
+		auto *const t
+		{
+			static_cast<block **>(std::realloc(table, count * sizeof(block *)))
+		};
+
+		if(unlikely(!t))
+			throw std::bad_alloc{};
+
+		table = t;
+		table_size = count;
+	}
+
+	auto *const b
+	{
+		new (ircd::allocator::allocate(alignof(std::max_align_t), pad_to(sizeof(block) + want, alignof(std::max_align_t)))) block
+	};
+
+	b->prev = head;
+	b->size = want;
+	head = b;
+	table[blocks++] = b;
+	block_size = std::min(block_size * 2, block_max);
+	end = b->data + b->size;
+	return reinterpret_cast<char *>(pad_to(uintptr_t(b->data), align));
+}
+
+/// Walks the blocks; scope::owns() decides in constant time for the
+/// allocations made in a scope.
+bool
+ircd::allocator::arena::owns(const void *const ptr)
+const noexcept
+{
+	const auto *const p(static_cast<const char *>(ptr));
+	if(p >= data(initial) && p < data(initial) + size(initial))
+		return true;
+
+	for(const auto *b(head); b; b = b->prev)
+		if(p >= b->data && p < b->data + b->size)
+			return true;
+
+	return false;
+}
+
+//
+// arena::scope
+//
+
+decltype(ircd::allocator::arena::scope::current)
+thread_local
+ircd::allocator::arena::scope::current;
+
+/// Prefix of each allocation made in a scope.
+struct ircd::allocator::arena::scope::tag
+{
+	size_t size;                                 // For realloc()
+	size_t block;                                // Index in the table; -1 initial
+};
+
+static_assert(sizeof(ircd::allocator::arena::scope::tag) <= sizeof(std::max_align_t));
+
+/// The tag before ptr is only trusted once ptr is found inside the block it
+/// names. The tag is never put on the page before the allocation, so it is
+/// only read when it shares the page of ptr, which must be mapped.
+bool
+ircd::allocator::arena::scope::owns(const arena &a,
+                                    const void *const ptr)
+noexcept
+{
+	const size_t page(4_KiB);
+	const auto *const p(static_cast<const char *>(ptr));
+	if(p >= data(a.initial) && p < data(a.initial) + size(a.initial))
+		return true;
+
+	if(!a.blocks || uintptr_t(p) % page < sizeof(std::max_align_t))
+		return false;
+
+	const auto &t
+	{
+		*reinterpret_cast<const tag *>(p - sizeof(std::max_align_t))
+	};
+
+	if(t.block >= a.blocks)
+		return false;
+
+	const auto *const b(a.table[t.block]);
+	return p >= b->data && p < b->data + b->size;
+}
+
+void *
+ircd::allocator::arena::scope::allocate(arena &a,
+                                        const size_t &size)
+{
+	const size_t page(4_KiB);
+	char *ret;
+	do
+	{
+		ret = static_cast<char *>(a.allocate(sizeof(std::max_align_t) + size));
+		ret += sizeof(std::max_align_t);
+	}
+	while(unlikely(uintptr_t(ret) % page == 0));
+
+	auto &t
+	{
+		*reinterpret_cast<tag *>(ret - sizeof(std::max_align_t))
+	};
+
+	t.size = size;
+	t.block = a.blocks - 1;
+	return ret;
+}
+
+ircd::allocator::arena::scope::scope(arena &a)
+:ircd::allocator::scope
+{
+	[&a](const size_t &size) -> void *
+	{
+		return allocate(a, size);
+	},
+	[this, &a](void *const &ptr, const size_t &size) -> void *
+	{
+		if(ptr && !owns(a, ptr))
+			return std::realloc(ptr, size);
+
+		void *const ret
+		{
+			user_alloc(size)
+		};
+
+		if(ptr)
+		{
+			const auto &old
+			{
+				reinterpret_cast<const tag *>(static_cast<char *>(ptr) - sizeof(std::max_align_t))->size
+			};
+
+			std::memcpy(ret, ptr, std::min(old, size));
+		}
+
+		return ret;
+	},
+	[&a](void *const &ptr)
+	{
+		if(ptr && !owns(a, ptr))
+			std::free(ptr);
+	}
+}
+,outer
+{
+	std::exchange(current, &a)
+}
+{
+}
+
+ircd::allocator::arena::scope::~scope()
+noexcept
+{
+	current = outer;
+}
+
+//
+// allocator::scope
+//
+
+decltype(ircd::allocator::scope::current)
+ircd::allocator::scope::current;
+
+ircd::allocator::scope::scope(alloc_closure ac,
+                              realloc_closure rc,
+                              free_closure fc)
+:theirs
+{
+	current
+}
+,user_alloc
+{
+	std::move(ac)
+}
+,user_realloc
+{
+	std::move(rc)
+}
+,user_free
+{
+	std::move(fc)
+}
+{
+	// If an allocator::scope instance already exists somewhere
+	// up the stack, *current will already be set. We only install
+	// our global hook handlers at the first instance ctor and
+	// uninstall it after that first instance dtors.
+	if(!current)
+		hook_init();
+
+	current = this;
+}
+
+ircd::allocator::scope::~scope()
+noexcept
+{
+	assert(current);
+	current = theirs;
+
+	// Reinstall the pre-existing hooks after our last scope instance
+	// has destructed (the first to have constructed). We know this when
+	// current becomes null.
+	if(!current)
+		hook_fini();
+}
+
+void
+__attribute__((weak))
+ircd::allocator::scope::hook_init()
+noexcept
+{
+}
+
+void
+__attribute__((weak))
+ircd::allocator::scope::hook_fini()
+noexcept
+{
+}
+
+//
+// allocator::profile
+//
+
+thread_local ircd::allocator::profile
+ircd::allocator::profile::this_thread
+{};
+
+ircd::allocator::profile
+ircd::allocator::operator-(const profile &a,
+                           const profile &b)
+{
+	profile ret(a);
+	ret -= b;
+	return ret;
+}
+
+ircd::allocator::profile
+ircd::allocator::operator+(const profile &a,
+                           const profile &b)
+{
+	profile ret(a);
+	ret += b;
+	return ret;
+}
+
+ircd::allocator::profile &
+ircd::allocator::operator-=(profile &a,
+                            const profile &b)
+{
+	a.alloc_count -= b.alloc_count;
+	a.free_count -= b.free_count;
+	a.alloc_bytes -= b.alloc_bytes;
+	a.free_bytes -= b.free_bytes;
+	return a;
+}
+
+ircd::allocator::profile &
+ircd::allocator::operator+=(profile &a,
+                            const profile &b)
+{
+	a.alloc_count += b.alloc_count;
+	a.free_count += b.free_count;
+	a.alloc_bytes += b.alloc_bytes;
+	a.free_bytes += b.free_bytes;
+	return a;
+}
+
+//
+// allocator::attribution
+//
+
+namespace ircd::allocator::attribution
+{
+	static std::mutex mutex;
+	static std::array<entry, 256> table;
+}
+
+decltype(ircd::allocator::attribution::enable)
+ircd::allocator::attribution::enable;
+
+decltype(ircd::allocator::attribution::dropped)
+ircd::allocator::attribution::dropped;
+
+bool
+ircd::allocator::attribution::for_each(const std::function<bool (const entry &)> &closure)
+{
+	for(const auto &entry : table)
+		if(entry.name[0] || (&entry == &table[0] && entry.count))
+			if(!closure(entry))
+				return false;
+
+	return true;
+}
+
+/// Entry for the name, added if it does not exist; null if the table is
+/// full. The first entry is reserved for the empty name. This is called from
+/// within operator new so it must not allocate.
+ircd::allocator::attribution::entry *
+ircd::allocator::attribution::find(const string_view &name)
+noexcept
+{
+	const string_view key
+	{
+		name.substr(0, sizeof(entry::name) - 1)
+	};
+
+	if(key.empty())
+		return &table[0];
+
+	const size_t slots(table.size() - 1);
+	const size_t start(std::hash<std::string_view>{}(key) % slots);
+	const std::lock_guard lock{mutex};
+	for(size_t i(0); i < slots; ++i)
+	{
+		auto &entry(table[1 + (start + i) % slots]);
+		if(string_view{entry.name} == key)
+			return &entry;
+
+		if(!entry.name[0])
+		{
+			std::copy(begin(key), end(key), entry.name);
+			entry.name[size(key)] = '\0';
+			return &entry;
+		}
+	}
+
+	return nullptr;
+}
+
+//
+// allocator::sampler
+//
+
+namespace ircd::allocator::sampler
+{
+	struct sample;
+
+	static void charge(void *, const size_t &) noexcept;
+	static void release(void *) noexcept;
+	[[gnu::noinline]] static void take(void *, const size_t &) noexcept;
+	[[gnu::noinline]] static void forget(void *) noexcept;
+	static size_t interval() noexcept;
+	static size_t slot(const void *) noexcept;
+
+	// The containers are never destroyed; memory is deleted through here
+	// until the very end.
+	static std::mutex mutex;
+	static std::map<std::vector<void *>, site> *sites;
+	static std::unordered_map<void *, sample> *samples_live;
+	static std::array<std::atomic<uint16_t>, 65536> filter;
+
+	static thread_local ssize_t countdown;
+	static thread_local bool sampling;
+}
+
+/// A live sampled allocation.
+struct ircd::allocator::sampler::sample
+{
+	size_t size;
+	struct site *site;
+	uint64_t seq;
+};
+
+decltype(ircd::allocator::sampler::rate)
+ircd::allocator::sampler::rate;
+
+decltype(ircd::allocator::sampler::samples)
+ircd::allocator::sampler::samples;
+
+decltype(ircd::allocator::sampler::live)
+ircd::allocator::sampler::live;
+
+/// Aggregates the live samples by backtrace. With since, only the samples
+/// taken after it are counted.
+ircd::allocator::sampler::snapshot
+ircd::allocator::sampler::snap(const snapshot *const since)
+{
+	snapshot ret;
+	const scope_restore sampling_
+	{
+		sampling, true
+	};
+
+	const std::lock_guard lock{mutex};
+	ret.rate = rate.load(std::memory_order_relaxed);
+	ret.seq = samples.load(std::memory_order_relaxed);
+	if(!sites)
+		return ret;
+
+	std::unordered_map<const site *, size_t> index;
+	ret.sites.reserve(sites->size());
+	for(const auto &[frames, site] : *sites)
+	{
+		index.emplace(&site, ret.sites.size());
+		auto &copy(ret.sites.emplace_back());
+		copy.frames = site.frames;
+		copy.total_count = site.total_count;
+		copy.total_bytes = site.total_bytes;
+	}
+
+	for(const auto &[ptr, sample] : *samples_live)
+		if(!since || sample.seq >= since->seq)
+		{
+			auto &site(ret.sites.at(index.at(sample.site)));
+			site.count += 1;
+			site.bytes += sample.size;
+		}
+
+	return ret;
+}
+
+/// What grew from base to now: each backtrace whose live samples increased,
+/// by the increase.
+ircd::allocator::sampler::snapshot
+ircd::allocator::sampler::diff(const snapshot &now,
+                               const snapshot &base)
+{
+	const scope_restore sampling_
+	{
+		sampling, true
+	};
+
+	snapshot ret;
+	ret.rate = now.rate;
+	ret.seq = now.seq;
+
+	auto it(begin(base.sites));
+	for(const auto &site : now.sites)
+	{
+		while(it != end(base.sites) && it->frames < site.frames)
+			++it;
+
+		const bool both(it != end(base.sites) && it->frames == site.frames);
+		const auto count(both? it->count: 0UL);
+		const auto bytes(both? it->bytes: 0UL);
+		if(site.count <= count && site.bytes <= bytes)
+			continue;
+
+		auto &grew(ret.sites.emplace_back());
+		grew.frames = site.frames;
+		grew.count = site.count - std::min(count, site.count);
+		grew.bytes = site.bytes - std::min(bytes, site.bytes);
+		grew.total_count = site.total_count - (both? it->total_count: 0UL);
+		grew.total_bytes = site.total_bytes - (both? it->total_bytes: 0UL);
+	}
+
+	return ret;
+}
+
+/// Writes the snapshot as a pprof legacy heap profile.
+std::ostream &
+ircd::allocator::sampler::dump(std::ostream &out,
+                               const snapshot &snapshot)
+{
+	const scope_restore sampling_
+	{
+		sampling, true
+	};
+
+	site sum;
+	for(const auto &site : snapshot.sites)
+	{
+		sum.count += site.count;
+		sum.bytes += site.bytes;
+		sum.total_count += site.total_count;
+		sum.total_bytes += site.total_bytes;
+	}
+
+	out << "heap profile: " << sum.count << ": " << sum.bytes
+	    << " [" << sum.total_count << ": " << sum.total_bytes << "]"
+	    << " @ heap_v2/" << snapshot.rate << '\n';
+
+	for(const auto &site : snapshot.sites)
+	{
+		if(!site.count && !site.total_count)
+			continue;
+
+		out << site.count << ": " << site.bytes
+		    << " [" << site.total_count << ": " << site.total_bytes << "] @";
+
+		for(const auto &frame : site.frames)
+			out << " 0x" << std::hex << uintptr_t(frame) << std::dec;
+
+		out << '\n';
+	}
+
+	out << "\nMAPPED_LIBRARIES:\n";
+	std::ifstream maps("/proc/self/maps");
+	out << maps.rdbuf();
+	return out;
+}
+
+[[gnu::always_inline]]
+inline void
+ircd::allocator::sampler::charge(void *const ptr,
+                                 const size_t &size)
+noexcept
+{
+	if(likely(!rate.load(std::memory_order_relaxed)))
+		return;
+
+	countdown -= size;
+	if(likely(countdown > 0))
+		return;
+
+	take(ptr, size);
+}
+
+[[gnu::always_inline]]
+inline void
+ircd::allocator::sampler::release(void *const ptr)
+noexcept
+{
+	if(likely(!live.load(std::memory_order_relaxed)))
+		return;
+
+	if(likely(!filter[slot(ptr)].load(std::memory_order_relaxed)))
+		return;
+
+	forget(ptr);
+}
+
+void
+ircd::allocator::sampler::take(void *const ptr,
+                               const size_t &size)
+noexcept try
+{
+	// Allocations made in here are not sampled.
+	if(sampling)
+		return;
+
+	const scope_restore sampling_
+	{
+		sampling, true
+	};
+
+	countdown = interval();
+
+	// Skip this frame and operator new.
+	constexpr size_t skip {2};
+	void *frame[site::frames_max + skip];
+	const int frames(::backtrace(frame, std::size(frame)));
+	std::vector<void *> key
+	{
+		frame + std::min(size_t(frames), skip), frame + frames
+	};
+
+	const std::lock_guard lock{mutex};
+	if(unlikely(!sites))
+	{
+		sites = new std::map<std::vector<void *>, site>;
+		samples_live = new std::unordered_map<void *, sample>;
+	}
+
+	const auto [it, added]
+	{
+		sites->try_emplace(std::move(key))
+	};
+
+	auto &site(it->second);
+	if(added)
+		site.frames = it->first;
+
+	site.count += 1;
+	site.bytes += size;
+	site.total_count += 1;
+	site.total_bytes += size;
+	samples_live->insert_or_assign(ptr, sample
+	{
+		size, &site, samples.fetch_add(1, std::memory_order_relaxed)
+	});
+
+	filter[slot(ptr)].fetch_add(1, std::memory_order_relaxed);
+	live.fetch_add(1, std::memory_order_relaxed);
+}
+catch(...)
+{
+	return;
+}
+
+void
+ircd::allocator::sampler::forget(void *const ptr)
+noexcept
+{
+	// Our own containers are freeing; they're never sampled.
+	if(sampling)
+		return;
+
+	const scope_restore sampling_
+	{
+		sampling, true
+	};
+
+	const std::lock_guard lock{mutex};
+	const auto it(samples_live->find(ptr));
+	if(it == end(*samples_live))
+		return;
+
+	auto &sample(it->second);
+	sample.site->count -= 1;
+	sample.site->bytes -= sample.size;
+	filter[slot(ptr)].fetch_sub(1, std::memory_order_relaxed);
+	live.fetch_sub(1, std::memory_order_relaxed);
+	samples_live->erase(it);
+}
+
+/// Bytes until the next sample; exponentially distributed about the rate.
+size_t
+ircd::allocator::sampler::interval()
+noexcept
+{
+	static thread_local uint64_t state;
+	if(unlikely(!state))
+		state = uintptr_t(&state) ^ uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+
+	// xorshift64*
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	const uint64_t r(state * 0x2545f4914f6cdd1dULL);
+	const double u((r >> 11) * 0x1.0p-53 + 0x1.0p-54);
+	return size_t(-std::log(u) * rate.load(std::memory_order_relaxed)) + 1;
+}
+
+size_t
+ircd::allocator::sampler::slot(const void *const ptr)
+noexcept
+{
+	return (uintptr_t(ptr) * 0x9e3779b97f4a7c15ULL) >> (64 - 16);
+}
+
+#ifndef RB_PROF_ALLOC
+void *
+__attribute__((alloc_size(1), malloc, returns_nonnull))
+operator new(const size_t size)
+{
+	if(auto *const arena(ircd::allocator::arena::scope::current); unlikely(arena))
+		return ircd::allocator::arena::scope::allocate(*arena, size?: 1);
+
+	void *const &ptr(::malloc(size?: 1));
+	if(unlikely(!ptr))
+		throw std::bad_alloc();
+
+	ircd::allocator::attribution::charge(size);
+	ircd::allocator::sampler::charge(ptr, size);
+	return ptr;
+}
+
+// The sample is forgotten before the memory can be reused.
+void
+operator delete(void *const ptr)
+noexcept
+{
+	if(auto *const arena(ircd::allocator::arena::scope::current); unlikely(arena && ircd::allocator::arena::scope::owns(*arena, ptr)))
+		return;
+
+	ircd::allocator::sampler::release(ptr);
+	::free(ptr);
+}
+
+void
+operator delete(void *const ptr,
+                const size_t size)
+noexcept
+{
+	if(auto *const arena(ircd::allocator::arena::scope::current); unlikely(arena && ircd::allocator::arena::scope::owns(*arena, ptr)))
+		return;
+
+	ircd::allocator::sampler::release(ptr);
+	::free(ptr);
+}
+#endif
+
+//
+// allocator::pressure
+//
+
+namespace ircd::allocator::pressure
+{
+	struct cgroup;
+
+	static const cgroup &find_cgroup();
+	static size_t read_value(const std::string &path) noexcept;
+	static void worker() noexcept;
+
+	static std::mutex evictors_mutex;
+	static evictor *evictors;
+
+	static std::mutex thread_mutex;
+	static std::condition_variable thread_cond;
+	static bool thread_stop;
+	static std::thread thread;
+
+	// Stops the controller if it is still running at exit.
+	static const struct thread_fini
+	{
+		~thread_fini() noexcept
+		{
+			stop();
+		}
+	}
+	thread_fini;
+}
+
+/// Paths of the memory files for our cgroup; empty when not found.
+struct ircd::allocator::pressure::cgroup
+{
+	std::string current;
+	std::string high;
+	std::string max;
+};
+
+decltype(ircd::allocator::pressure::limit)
+ircd::allocator::pressure::limit;
+
+decltype(ircd::allocator::pressure::high)
+ircd::allocator::pressure::high
+{
+	0.90f
+};
+
+decltype(ircd::allocator::pressure::low)
+ircd::allocator::pressure::low
+{
+	0.80f
+};
+
+decltype(ircd::allocator::pressure::interval)
+ircd::allocator::pressure::interval
+{
+	std::chrono::milliseconds{1000}
+};
+
+decltype(ircd::allocator::pressure::active)
+ircd::allocator::pressure::active;
+
+decltype(ircd::allocator::pressure::episodes)
+ircd::allocator::pressure::episodes;
+
+decltype(ircd::allocator::pressure::reclaims)
+ircd::allocator::pressure::reclaims;
+
+bool
+ircd::allocator::pressure::start()
+{
+	const std::lock_guard lock{thread_mutex};
+	if(thread.joinable())
+		return false;
+
+	thread_stop = false;
+	thread = std::thread{worker};
+	return true;
+}
+
+void
+ircd::allocator::pressure::stop()
+noexcept
+{
+	std::unique_lock lock{thread_mutex};
+	if(!thread.joinable())
+		return;
+
+	thread_stop = true;
+	thread_cond.notify_all();
+	auto joining(std::move(thread));
+	lock.unlock();
+	joining.join();
+}
+
+bool
+ircd::allocator::pressure::running()
+noexcept
+{
+	const std::lock_guard lock{thread_mutex};
+	return thread.joinable();
+}
+
+void
+ircd::allocator::pressure::worker()
+noexcept
+{
+	std::unique_lock lock{thread_mutex};
+	while(!thread_stop)
+	{
+		lock.unlock();
+		check();
+		lock.lock();
+		thread_cond.wait_for(lock, interval.load(std::memory_order_relaxed), []
+		{
+			return thread_stop;
+		});
+	}
+}
+
+/// One sample and step of the controller; reclaims when under pressure.
+/// Returns whether under pressure.
+bool
+ircd::allocator::pressure::check()
+noexcept try
+{
+	const auto sample
+	{
+		read()
+	};
+
+	// Nothing to measure against; pressure can't be known.
+	if(!sample.limit)
+	{
+		active.store(false, std::memory_order_relaxed);
+		return false;
+	}
+
+	const bool was
+	{
+		active.load(std::memory_order_relaxed)
+	};
+
+	const bool is
+	{
+		sample.usage >= sample.limit * (was? low: high).load(std::memory_order_relaxed)
+	};
+
+	active.store(is, std::memory_order_relaxed);
+	episodes.fetch_add(is && !was, std::memory_order_relaxed);
+	if(is)
+		reclaim(sample);
+
+	return is;
+}
+catch(const std::exception &e)
+{
+	return active.load(std::memory_order_relaxed);
+}
+
+/// Gives back memory until usage is estimated to be under the low mark.
+/// Returns the bytes estimated to be freed.
+size_t
+ircd::allocator::pressure::reclaim(const sample &sample)
+noexcept
+{
+	reclaims.fetch_add(1, std::memory_order_relaxed);
+
+	const size_t mark(sample.limit * low.load(std::memory_order_relaxed));
+	const size_t want
+	{
+		sample.usage > mark?
+			sample.usage - mark:
+			0UL
+	};
+
+	// The allocator's unused pages are given back first; nothing is lost.
+	size_t ret(0);
+	if(je::purge())
+		ret += sample.slack;
+	else
+		trim(0);
+
+	const std::lock_guard lock{evictors_mutex};
+	for(auto *e(evictors); e && ret < want; e = e->next) try
+	{
+		const size_t freed
+		{
+			e->function(want - ret)
+		};
+
+		e->calls.fetch_add(1, std::memory_order_relaxed);
+		e->evicted.fetch_add(freed, std::memory_order_relaxed);
+		ret += freed;
+	}
+	catch(const std::exception &)
+	{
+		continue;
+	}
+
+	return ret;
+}
+
+ircd::allocator::pressure::sample
+ircd::allocator::pressure::read()
+{
+	struct sample ret;
+
+	size_t pages, resident;
+	std::ifstream statm("/proc/self/statm");
+	if(statm >> pages >> resident)
+		ret.rss = resident * size_t(::sysconf(_SC_PAGESIZE));
+
+	const auto &cgroup
+	{
+		find_cgroup()
+	};
+
+	ret.cgroup_current = read_value(cgroup.current);
+	ret.cgroup_limit = read_value(cgroup.high)?: read_value(cgroup.max);
+
+	je::for_each([&ret](const auto &arena)
+	{
+		const auto stats(arena.stats());
+		ret.slack += stats.dirty + stats.muzzy;
+		return true;
+	});
+
+	ret.usage = ret.cgroup_current?: ret.rss;
+	ret.limit = limit.load(std::memory_order_relaxed)?: ret.cgroup_limit;
+	return ret;
+}
+
+/// Our memory cgroup from /proc/self/cgroup; the unified (v2) hierarchy
+/// first, otherwise the v1 memory controller. When the cgroup filesystem is
+/// namespaced its root is our cgroup, so that is tried when the path from
+/// /proc is not there.
+const ircd::allocator::pressure::cgroup &
+ircd::allocator::pressure::find_cgroup()
+{
+	static const cgroup ret{[]
+	{
+		const auto dir{[](const std::string &root, const std::string &path)
+		{
+			const std::string full(root + path);
+			return std::ifstream(full + "/cgroup.procs").good()? full: root;
+		}};
+
+		cgroup ret;
+		std::ifstream file("/proc/self/cgroup");
+		for(std::string line; std::getline(file, line);)
+		{
+			const auto colon(line.find(':'));
+			const auto colon2(line.find(':', colon + 1));
+			if(colon == line.npos || colon2 == line.npos)
+				continue;
+
+			const auto controllers(line.substr(colon + 1, colon2 - colon - 1));
+			const auto path(line.substr(colon2 + 1));
+			if(controllers.empty() && std::ifstream("/sys/fs/cgroup/cgroup.controllers").good())
+			{
+				const auto base(dir("/sys/fs/cgroup", path));
+				ret.current = base + "/memory.current";
+				ret.high = base + "/memory.high";
+				ret.max = base + "/memory.max";
+				break;
+			}
+
+			if(controllers == "memory")
+			{
+				const auto base(dir("/sys/fs/cgroup/memory", path));
+				ret.current = base + "/memory.usage_in_bytes";
+				ret.max = base + "/memory.limit_in_bytes";
+			}
+		}
+
+		return ret;
+	}()};
+
+	return ret;
+}
+
+/// Number in a cgroup file; zero when absent or unlimited ("max" for v2, or
+/// near the largest value for v1).
+size_t
+ircd::allocator::pressure::read_value(const std::string &path)
+noexcept
+{
+	if(path.empty())
+		return 0;
+
+	size_t ret(0);
+	std::ifstream file(path);
+	if(!(file >> ret))
+		return 0;
+
+	return ret < (1UL << 60)? ret: 0UL;
+}
+
+//
+// pressure::evictor
+//
+
+bool
+ircd::allocator::pressure::for_each(const std::function<bool (const evictor &)> &closure)
+{
+	const std::lock_guard lock{evictors_mutex};
+	for(const auto *e(evictors); e; e = e->next)
+		if(!closure(*e))
+			return false;
+
+	return true;
+}
+
+ircd::allocator::pressure::evictor::evictor(const string_view &name,
+                                            func function)
+:name{name}
+,function{std::move(function)}
+{
+	const std::lock_guard lock{evictors_mutex};
+	next = evictors;
+	evictors = this;
+}
+
+/// Waits for the evictor if the controller is calling it.
+ircd::allocator::pressure::evictor::~evictor()
+noexcept
+{
+	const std::lock_guard lock{evictors_mutex};
+	for(auto **it(&evictors); *it; it = &(*it)->next)
+		if(*it == this)
+		{
+			*it = next;
+			break;
+		}
+}
+
+//
+// Developer profiling
+//
+
+#ifdef RB_PROF_ALLOC // --------------------------------------------------
+
+void *
+__attribute__((alloc_size(1), malloc, returns_nonnull))
+operator new(const size_t size)
+{
+	if(auto *const arena(ircd::allocator::arena::scope::current); unlikely(arena))
+		return ircd::allocator::arena::scope::allocate(*arena, size?: 1);
+
+	void *const &ptr(::malloc(size));
+	if(unlikely(!ptr))
+		throw std::bad_alloc();
+
+	auto &this_thread(ircd::allocator::profile::this_thread);
+	this_thread.alloc_bytes += size;
+	this_thread.alloc_count++;
+
+	return ptr;
+}
+
+void
+operator delete(void *const ptr)
+noexcept
+{
+	if(auto *const arena(ircd::allocator::arena::scope::current); unlikely(arena && ircd::allocator::arena::scope::owns(*arena, ptr)))
+		return;
+
+	::free(ptr);
+
+	auto &this_thread(ircd::allocator::profile::this_thread);
+	this_thread.free_count++;
+}
+
+void
+operator delete(void *const ptr,
+                const size_t size)
+noexcept
+{
+	if(auto *const arena(ircd::allocator::arena::scope::current); unlikely(arena && ircd::allocator::arena::scope::owns(*arena, ptr)))
+		return;
+
 	::free(ptr);
 
 	auto &this_thread(ircd::allocator::profile::this_thread);
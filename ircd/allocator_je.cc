@@ -11,6 +11,11 @@ namespace ircd::allocator::je
 	static void stats_handler(void *, const char *) noexcept;
 
 	static std::function<callback_prototype> stats_callback;
+
+	template<class T> static bool ctl(const string_view &key, T *out, const T *in = nullptr) noexcept;
+
+	static std::mutex arenas_mutex;
+	static arena *arenas;
 	// extern info::versions malloc_version_api;
 	// extern info::versions malloc_version_abi;
 }
@@ -182,4 +187,272 @@ ircd::allocator::scope::hook_fini()
 noexcept
 {
 }
-#endif
\ No newline at end of file
+#endif
+
+//
+// je::arena
+//
+
+decltype(ircd::allocator::je::arena::ctx_stack)
+ircd::allocator::je::arena::ctx_stack
+{
+	"ircd.ctx.stack", 30000, 30000
+};
+
+decltype(ircd::allocator::je::arena::io_buffer)
+ircd::allocator::je::arena::io_buffer
+{
+	"ircd.io.buffer", 1000, 5000
+};
+
+decltype(ircd::allocator::je::arena::handler)
+ircd::allocator::je::arena::handler
+{
+	"ircd.ios.handler", 1000, 5000
+};
+
+decltype(ircd::allocator::je::arena::cache)
+ircd::allocator::je::arena::cache
+{
+	"ircd.cache", -1, -1
+};
+
+bool
+ircd::allocator::je::for_each(const std::function<bool (const arena &)> &closure)
+{
+	const std::lock_guard lock{arenas_mutex};
+	for(const auto *a(arenas); a; a = a->next)
+		if(!closure(*a))
+			return false;
+
+	return true;
+}
+
+ircd::allocator::je::arena::arena(const string_view &name,
+                                  const ssize_t &dirty_decay_ms,
+                                  const ssize_t &muzzy_decay_ms)
+:name{name}
+,dirty_decay_ms{dirty_decay_ms}
+,muzzy_decay_ms{muzzy_decay_ms}
+{
+	if(create())
+		decay(dirty_decay_ms, muzzy_decay_ms);
+
+	const std::lock_guard lock{arenas_mutex};
+	next = arenas;
+	arenas = this;
+}
+
+/// jemalloc has no way to destroy an arena which may still hold allocations;
+/// the arena index is abandoned after being purged.
+ircd::allocator::je::arena::~arena()
+noexcept
+{
+	{
+		const std::lock_guard lock{arenas_mutex};
+		for(auto **it(&arenas); *it; it = &(*it)->next)
+			if(*it == this)
+			{
+				*it = next;
+				break;
+			}
+	}
+
+	purge();
+}
+
+bool
+ircd::allocator::je::arena::create()
+noexcept
+{
+	return ctl<uint>("arenas.create", &id);
+}
+
+bool
+ircd::allocator::je::arena::decay(const ssize_t &dirty_ms,
+                                  const ssize_t &muzzy_ms)
+noexcept
+{
+	if(!id)
+		return false;
+
+	char key[64];
+	bool ret(true);
+	std::snprintf(key, sizeof(key), "arena.%u.dirty_decay_ms", id);
+	ret &= ctl<ssize_t>(key, nullptr, &dirty_ms);
+	std::snprintf(key, sizeof(key), "arena.%u.muzzy_decay_ms", id);
+	ret &= ctl<ssize_t>(key, nullptr, &muzzy_ms);
+	if(ret)
+	{
+		dirty_decay_ms = dirty_ms;
+		muzzy_decay_ms = muzzy_ms;
+	}
+
+	return ret;
+}
+
+void
+ircd::allocator::je::arena::purge()
+noexcept
+{
+	if(!id)
+		return;
+
+	char key[64];
+	std::snprintf(key, sizeof(key), "arena.%u.purge", id);
+	ctl<char>(key, nullptr);
+}
+
+struct ircd::allocator::je::arena::stats
+ircd::allocator::je::arena::stats()
+const
+{
+	struct stats ret;
+	if(!id)
+		return ret;
+
+	// Stats are cached by jemalloc until the epoch is advanced.
+	uint64_t epoch(1);
+	ctl<uint64_t>("epoch", &epoch, &epoch);
+
+	size_t page(0);
+	ctl<size_t>("arenas.page", &page);
+
+	const auto get{[this](const char *const name) -> size_t
+	{
+		char key[96];
+		size_t val(0);
+		std::snprintf(key, sizeof(key), "stats.arenas.%u.%s", id, name);
+		ctl<size_t>(key, &val);
+		return val;
+	}};
+
+	ret.allocated = get("small.allocated") + get("large.allocated");
+	ret.active = get("pactive") * page;
+	ret.dirty = get("pdirty") * page;
+	ret.muzzy = get("pmuzzy") * page;
+	ret.mapped = get("mapped");
+	ret.resident = get("resident");
+	return ret;
+}
+
+void *
+ircd::allocator::je::arena::allocate(const size_t &size,
+                                     const size_t &align)
+{
+	#if defined(IRCD_ALLOCATOR_JEMALLOC)
+	if(likely(id))
+	{
+		void *const ret
+		{
+			::mallocx(size?: 1, MALLOCX_ARENA(id) | MALLOCX_ALIGN(align) | MALLOCX_TCACHE_NONE)
+		};
+
+		if(unlikely(!ret))
+			throw std::bad_alloc{};
+
+		return ret;
+	}
+	#endif
+
+	const auto a(std::max(align, sizeof(void *)));
+	return ircd::allocator::allocate(a, pad_to(size?: 1, a));
+}
+
+void
+ircd::allocator::je::arena::deallocate(void *const ptr,
+                                       const size_t &size)
+noexcept
+{
+	#if defined(IRCD_ALLOCATOR_JEMALLOC)
+	if(likely(id && ptr))
+		return ::dallocx(ptr, MALLOCX_TCACHE_NONE);
+	#endif
+
+	std::free(ptr);
+}
+
+//
+// je::arena::scope
+//
+
+decltype(ircd::allocator::je::arena::scope::current)
+thread_local
+ircd::allocator::je::arena::scope::current;
+
+ircd::allocator::je::arena::scope::scope(arena &a)
+:theirs
+{
+	current
+}
+{
+	if(!a.id)
+		return;
+
+	tcache_flush();
+	ctl<uint>("thread.arena", &their_id, &a.id);
+	current = this;
+}
+
+ircd::allocator::je::arena::scope::~scope()
+noexcept
+{
+	if(current != this)
+		return;
+
+	tcache_flush();
+	ctl<uint>("thread.arena", nullptr, &their_id);
+	current = theirs;
+}
+
+//
+// je::tcache
+//
+
+bool
+ircd::allocator::je::tcache(const bool &enable)
+{
+	bool ret(false);
+	ctl<bool>("thread.tcache.enabled", &ret, &enable);
+	return ret;
+}
+
+void
+ircd::allocator::je::tcache_flush()
+noexcept
+{
+	ctl<char>("thread.tcache.flush", nullptr);
+}
+
+//
+// je::purge
+//
+
+/// Purges the unused pages of every arena, including jemalloc's own.
+bool
+ircd::allocator::je::purge()
+noexcept
+{
+	// MALLCTL_ARENAS_ALL
+	return ctl<char>("arena.4096.purge", nullptr);
+}
+
+/// mallctl(3) reading the current value into out and writing in when given.
+/// False when unsuccessful or not available.
+template<class T>
+bool
+ircd::allocator::je::ctl(const string_view &key_,
+                         T *const out,
+                         const T *const in)
+noexcept
+{
+	#if defined(IRCD_ALLOCATOR_JEMALLOC)
+	char key[128];
+	strlcpy(key, key_);
+
+	size_t len(sizeof(T));
+	return ::mallctl(key, out, out? &len: nullptr, mutable_cast(in), in? sizeof(T): 0UL) == 0;
+	#else
+	return false;
+	#endif
+}
@@ -0,0 +1,211 @@
+#include <RB_INC_OPENSSL_SHA_H
+#include <RB_INC_OPENSSL_EVP_H
+#include <RB_INC_LZ4_H
+#include <RB_INC_ZSTD_H
+#if defined(HAVE_SODIUM_H)
+#include <RB_INC_SODIUM_H
+#endif
+
+namespace ircd::batch
+{
+	static void for_each(const string_view &name, const vector_view<const const_buffer> &, const std::function<void (const size_t &)> &);
+}
+
+/// Input bytes in each unit of work given to a worker; about the size of a
+/// core's L2 so the inputs of a chunk stay in cache while it is processed.
+decltype(ircd::batch::chunk_size)
+ircd::batch::chunk_size
+{
+	256_KiB
+};
+
+void
+ircd::batch::for_each(const vector_view<const const_buffer> &in,
+                      const std::function<void (const size_t &)> &func)
+{
+	for_each("ircd.batch", in, func);
+}
+
+/// Calls func with the index of every input on the workers; each worker
+/// takes the next chunk of inputs until none remain.
+void
+ircd::batch::for_each(const string_view &name,
+                      const vector_view<const const_buffer> &in,
+                      const std::function<void (const size_t &)> &func)
+{
+	if(in.empty())
+		return;
+
+	// Boundaries of each chunk as indexes into the input.
+	std::vector<size_t> bound {0};
+	for(size_t i(0), bytes(0); i < in.size(); ++i)
+	{
+		bytes += size(in[i]);
+		if(bytes >= chunk_size || i + 1 == in.size())
+		{
+			bound.emplace_back(i + 1);
+			bytes = 0;
+		}
+	}
+
+	const size_t chunks
+	{
+		bound.size() - 1
+	};
+
+	ctx::ole::opts opts;
+	opts.name = name;
+	opts.concurrency = std::clamp(chunks, 1UL, std::max(ctx::ole::thread_max, 1UL));
+
+	std::atomic<size_t> next {0};
+	ctx::offload
+	{
+		opts, [&bound, &next, &chunks, &func](const size_t &rank)
+		{
+			for(size_t chunk; (chunk = next.fetch_add(1, std::memory_order_relaxed)) < chunks;)
+				for(size_t i(bound[chunk]); i < bound[chunk + 1]; ++i)
+					func(i);
+		}
+	};
+}
+
+bool
+ircd::batch::sha256(const vector_view<sha256_buf> &out,
+                    const vector_view<const const_buffer> &in)
+{
+	assert(out.size() >= in.size());
+
+	#if defined(HAVE_OPENSSL_SHA_H)
+	for_each("ircd.batch.sha256", in, [&out, &in](const size_t &i)
+	{
+		const auto &buf(in[i]);
+		::SHA256(reinterpret_cast<const uint8_t *>(data(buf)), size(buf), out[i].data());
+	});
+
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+bool
+ircd::batch::compress(const vector_view<mutable_buffer> &out,
+                      const vector_view<const const_buffer> &in,
+                      const codec &codec,
+                      const int &level)
+{
+	assert(out.size() >= in.size());
+	switch(codec)
+	{
+		case codec::LZ4:
+		#if defined(HAVE_LZ4_H)
+			for_each("ircd.batch.lz4", in, [&out, &in](const size_t &i)
+			{
+				// LZ4 takes int sizes; larger inputs are not compressed.
+				const auto len
+				{
+					size(in[i]) <= LZ4_MAX_INPUT_SIZE?
+						::LZ4_compress_default
+						(
+							data(in[i]),
+							data(out[i]),
+							int(size(in[i])),
+							int(std::min(size(out[i]), size_t(INT_MAX)))
+						):
+						0
+				};
+
+				out[i] = mutable_buffer{data(out[i]), size_t(std::max(len, 0))};
+			});
+			return true;
+		#else
+			break;
+		#endif
+
+		case codec::ZSTD:
+		#if defined(HAVE_ZSTD_H)
+			for_each("ircd.batch.zstd", in, [&out, &in, &level](const size_t &i)
+			{
+				const auto len
+				{
+					::ZSTD_compress(data(out[i]), size(out[i]), data(in[i]), size(in[i]), level)
+				};
+
+				out[i] = mutable_buffer{data(out[i]), ::ZSTD_isError(len)? 0UL: len};
+			});
+			return true;
+		#else
+			break;
+		#endif
+	}
+
+	return false;
+}
+
+bool
+ircd::batch::verify(const vector_view<bool> &out,
+                    const vector_view<const const_buffer> &msg,
+                    const vector_view<const const_buffer> &sig,
+                    const vector_view<const const_buffer> &pk)
+{
+	assert(out.size() >= msg.size());
+	assert(sig.size() >= msg.size());
+	assert(pk.size() >= msg.size());
+
+	#if defined(HAVE_SODIUM_H)
+	if(unlikely(::sodium_init() < 0))
+		return false;
+
+	for_each("ircd.batch.verify", msg, [&out, &msg, &sig, &pk](const size_t &i)
+	{
+		out[i] = false;
+		if(size(pk[i]) != crypto_sign_PUBLICKEYBYTES || size(sig[i]) != crypto_sign_BYTES)
+			return;
+
+		out[i] = ::crypto_sign_verify_detached
+		(
+			reinterpret_cast<const uint8_t *>(data(sig[i])),
+			reinterpret_cast<const uint8_t *>(data(msg[i])), size(msg[i]),
+			reinterpret_cast<const uint8_t *>(data(pk[i]))
+		) == 0;
+	});
+
+	return true;
+	#elif defined(HAVE_OPENSSL_EVP_H)
+	// Only for builds configured without libsodium.
+	for_each("ircd.batch.verify", msg, [&out, &msg, &sig, &pk](const size_t &i)
+	{
+		out[i] = false;
+		if(size(pk[i]) != 32 || size(sig[i]) != 64)
+			return;
+
+		const std::unique_ptr<EVP_PKEY, void (*)(EVP_PKEY *)> key
+		{
+			::EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, reinterpret_cast<const uint8_t *>(data(pk[i])), size(pk[i])),
+			::EVP_PKEY_free
+		};
+
+		const std::unique_ptr<EVP_MD_CTX, void (*)(EVP_MD_CTX *)> md
+		{
+			::EVP_MD_CTX_new(), ::EVP_MD_CTX_free
+		};
+
+		if(!key || !md)
+			return;
+
+		if(::EVP_DigestVerifyInit(md.get(), nullptr, nullptr, nullptr, key.get()) != 1)
+			return;
+
+		out[i] = ::EVP_DigestVerify
+		(
+			md.get(),
+			reinterpret_cast<const uint8_t *>(data(sig[i])), size(sig[i]),
+			reinterpret_cast<const uint8_t *>(data(msg[i])), size(msg[i])
+		) == 1;
+	});
+
+	return true;
+	#else
+	return false;
+	#endif
+}
@@ -0,0 +1,279 @@
+namespace ircd::buffer::rc
+{
+	struct cache;
+	struct depot;
+
+	static uint32_t class_of(const size_t &bytes) noexcept;
+	static size_t limit(const uint32_t &cls) noexcept;
+
+	extern thread_local cache tl_cache;
+	extern struct depot depot;
+	extern allocator::pressure::evictor evictor;
+}
+
+/// Freed blocks of each class on a thread, linked through their first word.
+/// Given to the depot when the thread exits.
+struct ircd::buffer::rc::cache
+{
+	struct block
+	{
+		block *next;
+	};
+
+	std::array<block *, classes> head {nullptr};
+	std::array<size_t, classes> count {0};
+
+  public:
+	size_t trim() noexcept;
+
+	~cache() noexcept;
+};
+
+/// Blocks given back by threads for any thread to reuse. A thread's cache
+/// spills half of a class here when it is full and refills from here before
+/// allocating from the heap; so blocks freed on one thread (i.e. an ole
+/// worker) return to the others. Freed to the heap under memory pressure.
+struct ircd::buffer::rc::depot
+{
+	std::mutex mutex;
+	std::array<cache::block *, classes> head {nullptr};
+	std::array<size_t, classes> count {0};
+
+  public:
+	size_t take(cache &, const uint32_t &cls) noexcept;
+	void give(cache &, const uint32_t &cls, const size_t &n) noexcept;
+	size_t trim() noexcept;
+};
+
+static_assert(ircd::buffer::rc::class_min << (ircd::buffer::rc::classes - 1) == ircd::buffer::rc::class_max);
+static_assert(sizeof(ircd::buffer::rc::header) <= ircd::buffer::rc::class_min);
+
+decltype(ircd::buffer::rc::tl_cache)
+thread_local
+ircd::buffer::rc::tl_cache;
+
+decltype(ircd::buffer::rc::depot)
+ircd::buffer::rc::depot;
+
+decltype(ircd::buffer::rc::cache_bytes)
+ircd::buffer::rc::cache_bytes
+{
+	256 * 1024
+};
+
+decltype(ircd::buffer::rc::evictor)
+ircd::buffer::rc::evictor
+{
+	"ircd.buffer.rc", [](const size_t &want) -> size_t
+	{
+		return depot.trim();
+	}
+};
+
+decltype(ircd::buffer::rc::stats)
+ircd::buffer::rc::stats;
+
+ircd::buffer::rc::header *
+ircd::buffer::rc::allocate(const size_t &size)
+{
+	const size_t bytes
+	{
+		sizeof(header) + size
+	};
+
+	const auto cls
+	{
+		class_of(bytes)
+	};
+
+	stats.allocs.fetch_add(1, std::memory_order_relaxed);
+	void *ptr;
+	if(likely(cls < classes) && (tl_cache.head[cls] || depot.take(tl_cache, cls)))
+	{
+		auto *const b(tl_cache.head[cls]);
+		tl_cache.head[cls] = b->next;
+		tl_cache.count[cls]--;
+		stats.reuses.fetch_add(1, std::memory_order_relaxed);
+		ptr = b;
+	}
+	else if(likely(cls < classes))
+		ptr = allocator::allocate(alignof(header), class_min << cls);
+	else
+	{
+		stats.outsized.fetch_add(1, std::memory_order_relaxed);
+		ptr = allocator::allocate(alignof(header), pad_to(bytes, alignof(header)));
+	}
+
+	auto *const ret(new (ptr) header);
+	ret->cls = cls;
+	return ret;
+}
+
+void
+ircd::buffer::rc::deallocate(header *const &hdr)
+noexcept
+{
+	assert(hdr);
+	assert(hdr->refs == 0);
+	const auto cls(hdr->cls);
+	stats.frees.fetch_add(1, std::memory_order_relaxed);
+	if(unlikely(cls >= classes))
+		return std::free(hdr);
+
+	if(unlikely(tl_cache.count[cls] >= limit(cls)))
+		depot.give(tl_cache, cls, tl_cache.count[cls] / 2);
+
+	auto *const b(reinterpret_cast<cache::block *>(hdr));
+	b->next = tl_cache.head[cls];
+	tl_cache.head[cls] = b;
+	tl_cache.count[cls]++;
+}
+
+/// Frees the blocks cached by the calling thread and those in the depot;
+/// returns the bytes freed.
+size_t
+ircd::buffer::rc::trim()
+noexcept
+{
+	return tl_cache.trim() + depot.trim();
+}
+
+/// Blocks of the class a thread caches; at least two so half can spill.
+size_t
+ircd::buffer::rc::limit(const uint32_t &cls)
+noexcept
+{
+	return std::max(cache_bytes / (class_min << cls), 2UL);
+}
+
+uint32_t
+ircd::buffer::rc::class_of(const size_t &bytes)
+noexcept
+{
+	if(unlikely(bytes > class_max))
+		return classes;
+
+	const size_t pow2
+	{
+		std::bit_ceil(std::max(bytes, class_min))
+	};
+
+	return std::countr_zero(pow2) - std::countr_zero(class_min);
+}
+
+//
+// cache
+//
+
+ircd::buffer::rc::cache::~cache()
+noexcept
+{
+	for(uint32_t cls(0); cls < classes; ++cls)
+		depot.give(*this, cls, count[cls]);
+}
+
+size_t
+ircd::buffer::rc::cache::trim()
+noexcept
+{
+	size_t ret(0);
+	for(size_t cls(0); cls < classes; ++cls)
+	{
+		while(head[cls])
+		{
+			auto *const b(head[cls]);
+			head[cls] = b->next;
+			std::free(b);
+			ret += class_min << cls;
+		}
+
+		count[cls] = 0;
+	}
+
+	return ret;
+}
+
+//
+// depot
+//
+
+/// Refills the cache with up to half its limit of the class; returns the
+/// number of blocks moved.
+size_t
+ircd::buffer::rc::depot::take(cache &cache,
+                              const uint32_t &cls)
+noexcept
+{
+	const size_t want
+	{
+		limit(cls) / 2
+	};
+
+	const std::lock_guard lock{mutex};
+	if(!head[cls])
+		return 0;
+
+	size_t ret(1);
+	auto *const first(head[cls]);
+	auto *last(first);
+	for(; ret < want && last->next; ++ret)
+		last = last->next;
+
+	head[cls] = last->next;
+	count[cls] -= ret;
+	last->next = cache.head[cls];
+	cache.head[cls] = first;
+	cache.count[cls] += ret;
+	stats.depot.fetch_add(1, std::memory_order_relaxed);
+	return ret;
+}
+
+/// Moves the first n blocks of the class from the cache.
+void
+ircd::buffer::rc::depot::give(cache &cache,
+                              const uint32_t &cls,
+                              const size_t &n)
+noexcept
+{
+	if(!n)
+		return;
+
+	assert(n <= cache.count[cls]);
+	auto *const first(cache.head[cls]);
+	auto *last(first);
+	for(size_t i(1); i < n; ++i)
+		last = last->next;
+
+	cache.head[cls] = last->next;
+	cache.count[cls] -= n;
+
+	const std::lock_guard lock{mutex};
+	last->next = head[cls];
+	head[cls] = first;
+	count[cls] += n;
+}
+
+size_t
+ircd::buffer::rc::depot::trim()
+noexcept
+{
+	decltype(head) blocks;
+	{
+		const std::lock_guard lock{mutex};
+		blocks = head;
+		head.fill(nullptr);
+		count.fill(0);
+	}
+
+	size_t ret(0);
+	for(size_t cls(0); cls < classes; ++cls)
+		while(blocks[cls])
+		{
+			auto *const b(blocks[cls]);
+			blocks[cls] = b->next;
+			std::free(b);
+			ret += class_min << cls;
+		}
+
+	return ret;
+}
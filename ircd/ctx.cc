@@ -11,22 +11,13 @@
 // ctx::ctx (internal)
 //
 
-/// Allocator instance for the ctx instance_list. This allocator will place
-/// the std::list nodes in the ctx struct itself.
-template<>
-decltype(ircd::util::instance_list<ircd::ctx::ctx>::allocator)
-ircd::util::instance_list<ircd::ctx::ctx>::allocator
-{};
-
-/// Instance list linkage for the list of all ctx instances. All ctxs can be
-/// iterated through this list. The allocator makes the overhead of this list
-/// negligible.
-template<>
-decltype(ircd::util::instance_list<ircd::ctx::ctx>::list)
-ircd::util::instance_list<ircd::ctx::ctx>::list
-{
-	allocator
-};
+/// Registry of all ctx instances created on this thread. Each thread running
+/// an event loop (the main thread or an ios::shard) has its own world of
+/// contexts; all ctxs of the calling thread can be iterated through this
+/// list. The linkage is intrusive in the ctx so the overhead is negligible.
+decltype(ircd::ctx::ctx::instances)
+thread_local
+ircd::ctx::ctx::instances;
 
 /// Monotonic ctx id counter state. This counter is incremented for each
 /// newly created context.
@@ -36,6 +27,13 @@ ircd::ctx::ctx::id_ctr
 	0
 };
 
+template<>
+ircd::allocator::slab_pool
+ircd::allocator::slab<ircd::ctx::ctx>::pool
+{
+	"ircd.ctx.ctx", sizeof(ircd::ctx::ctx), alignof(ircd::ctx::ctx)
+};
+
 /// This is a pseudo ircd::ios descriptor. We want to account for a ctx's
 /// execution slice in the ircd::ios handler list. This posits the entire
 /// ircd::ctx system as one ircd::ios handler type among all the others.
@@ -49,6 +47,7 @@ ircd::ctx::ctx::ios_desc
 
 /// This is a pseudo ircd::ios handler. See ios_desc
 decltype(ircd::ctx::ctx::ios_handler)
+thread_local
 ircd::ctx::ctx::ios_handler
 {
 	&ios_desc
@@ -57,11 +56,13 @@ ircd::ctx::ctx::ios_handler
 /// Points to the next context to spawn (internal use)
 [[gnu::visibility("hidden")]]
 decltype(ircd::ctx::ctx::spawning)
+thread_local
 ircd::ctx::ctx::spawning;
 
 /// Used to notify of context completion
 [[gnu::visibility("hidden")]]
 decltype(ircd::ctx::ctx::adjoindre)
+thread_local
 ircd::ctx::ctx::adjoindre;
 
 /// Internal context struct ctor
@@ -83,6 +84,12 @@ ircd::ctx::ctx::ctx(const string_view &name,
 }
 {
 	strlcpy(this->name, name);
+
+	instance_next = *registry;
+	if(instance_next)
+		instance_next->instance_prev = this;
+
+	*registry = this;
 }
 
 [[gnu::visibility("hidden")]]
@@ -90,6 +97,14 @@ ircd::ctx::ctx::~ctx()
 noexcept
 {
 	assert(yc == nullptr); // Check that the context isn't active.
+
+	if(instance_next)
+		instance_next->instance_prev = instance_prev;
+
+	if(instance_prev)
+		instance_prev->instance_next = instance_next;
+	else
+		*registry = instance_next;
 }
 
 /// Internal wrapper for asio::spawn; never call directly.
@@ -481,6 +496,90 @@ const noexcept
 	return started() && yc == nullptr;
 }
 
+//
+// allocator::attribution
+//
+
+/// The allocator is charging an allocation; find who to charge. Each
+/// context and descriptor looks up its entry once.
+ircd::allocator::attribution::entry *
+ircd::allocator::attribution::target()
+noexcept
+{
+	if(likely(ircd::ctx::current))
+	{
+		auto &ctx(*ircd::ctx::current);
+		if(unlikely(!ctx.attribution))
+			ctx.attribution = find(name(ctx));
+
+		return ctx.attribution;
+	}
+
+	if(ios::handler::current && ios::handler::current->descriptor)
+	{
+		auto &descriptor(*ios::handler::current->descriptor);
+		if(unlikely(!descriptor.attribution))
+			descriptor.attribution = find(descriptor.name);
+
+		return descriptor.attribution;
+	}
+
+	return find({});
+}
+
+//
+// allocator::pressure
+//
+
+namespace ircd::ctx
+{
+	static void shrink();
+
+	extern ios::descriptor pressure_desc;
+	extern allocator::pressure::evictor pressure_evictor;
+	static std::atomic<bool> pressure_pending;
+}
+
+decltype(ircd::ctx::pressure_desc)
+ircd::ctx::pressure_desc
+{
+	"ircd.ctx.pressure"
+};
+
+/// Under memory pressure the loop is asked to end idle pool contexts beyond
+/// what each pool started with and to purge the stack arena.
+decltype(ircd::ctx::pressure_evictor)
+ircd::ctx::pressure_evictor
+{
+	"ircd.ctx.pool", [](const size_t &want) -> size_t
+	{
+		if(!ios::available() || pressure_pending.exchange(true))
+			return 0;
+
+		boost::asio::post(ios::main, ios::handle
+		{
+			pressure_desc, []
+			{
+				shrink();
+			}
+		});
+
+		// What is freed isn't known until the loop has run it.
+		return 0;
+	}
+};
+
+/// Called on the loop thread.
+void
+ircd::ctx::shrink()
+{
+	pressure_pending.store(false);
+	for(auto *pool(pool::list); pool; pool = pool->next)
+		pool->shrink(pool->opt->initial_ctxs);
+
+	allocator::je::arena::ctx_stack.purge();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // ctx/ctx.h
@@ -494,10 +593,12 @@ noexcept
 	return ctx::ios_handler.epoch;
 }
 
+/// Iterate the contexts of the calling thread's event loop, most recently
+/// created first.
 bool
 ircd::ctx::for_each(const std::function<bool (ctx &)> &closure)
 {
-	for(auto &ctx : ctx::list)
+	for(auto *ctx(ctx::instances); ctx; ctx = ctx->instance_next)
 		if(!closure(*ctx))
 			return false;
 
@@ -563,15 +664,17 @@ ircd::ctx::signal_desc
 
 /// Executes `func` sometime between executions of `ctx` with thread-safety
 /// so `func` and `ctx` are never executed concurrently no matter how many
-/// threads the io_service has available to execute events on.
+/// threads the io_service has available to execute events on. The function
+/// is queued to the event loop which `ctx` belongs to (i.e. its ios::shard)
+/// rather than the loop of the calling thread.
 void
 ircd::ctx::signal(ctx &ctx,
                   std::function<void ()> func)
 {
-	ios::dispatch
+	boost::asio::post(ctx.alarm.get_executor(), ios::handle
 	{
-		signal_desc, ios::defer, std::move(func)
-	};
+		signal_desc, std::move(func)
+	});
 }
 
 /// Marks `ctx` for termination. Terminate is similar to interrupt() but the
@@ -619,6 +722,7 @@ ircd::ctx::name(ctx &ctx,
 noexcept
 {
 	strlcpy(ctx.name, name);
+	ctx.attribution = nullptr;
 }
 
 int8_t
@@ -1402,6 +1506,10 @@ decltype(ircd::ctx::pool::default_opts)
 ircd::ctx::pool::default_opts
 {};
 
+decltype(ircd::ctx::pool::list)
+thread_local
+ircd::ctx::pool::list;
+
 //
 // pool::pool
 //
@@ -1415,11 +1523,21 @@ ircd::ctx::pool::pool(const string_view &name,
 	// case for some static instances of pool: initial_ctxs value is ignored.
 	if(ircd::ios::available())
 		add(this->opt->initial_ctxs);
+
+	next = list;
+	list = this;
 }
 
 ircd::ctx::pool::~pool()
 noexcept
 {
+	for(auto **it(&list); *it; it = &(*it)->next)
+		if(*it == this)
+		{
+			*it = next;
+			break;
+		}
+
 	terminate();
 	join();
 
@@ -1454,9 +1572,49 @@ ircd::ctx::pool::min(const size_t &num)
 		set(num);
 }
 
+/// Ends idle contexts until keep are left running (or all the rest are
+/// working). An empty job is queued for each; the context which takes one
+/// exits instead of running it, releasing its stack, and the finished
+/// contexts are removed by the next call. Returns the number asked to exit.
+size_t
+ircd::ctx::pool::shrink(const size_t &keep)
+{
+	reap();
+	const size_t remaining
+	{
+		running - std::min(running, shedding)
+	};
+
+	const size_t idle
+	{
+		avail() - std::min(avail(), shedding)
+	};
+
+	const size_t ret
+	{
+		std::min(idle, remaining - std::min(remaining, keep))
+	};
+
+	shedding += ret;
+	for(size_t i(0); i < ret; ++i)
+		q.push(closure{});
+
+	return ret;
+}
+
+void
+ircd::ctx::pool::reap()
+{
+	std::erase_if(ctxs, [](const auto &context)
+	{
+		return context.joined();
+	});
+}
+
 void
 ircd::ctx::pool::set(const size_t &num)
 {
+	reap();
 	if(size() > num)
 		del(size() - num);
 	else
@@ -1530,6 +1688,7 @@ ircd::ctx::pool::operator()(closure closure)
 			opt->queue_max_hard
 		};
 
+	assert(closure);
 	q.push(std::move(closure));
 }
 
@@ -1558,7 +1717,12 @@ noexcept try
 
 	q_max.notify();
 	while(!termination(cur()))
-		work();
+		if(unlikely(!work()))
+		{
+			assert(shedding);
+			--shedding;
+			break;
+		}
 }
 catch(const interrupted &e)
 {
@@ -1575,7 +1739,9 @@ catch(const terminated &e)
 //	};
 }
 
-void
+/// Runs the next job; false when it was an empty job from shrink(), which
+/// this context must exit for.
+bool
 ircd::ctx::pool::work()
 try
 {
@@ -1594,6 +1760,9 @@ try
 		q_max
 	};
 
+	if(unlikely(!func))
+		return false;
+
 	const scope_count working
 	{
 		this->working
@@ -1605,11 +1774,12 @@ try
 	// Check for latent interruption to this ctx. If there's anything pending
 	// it's best to get rid of it sooner rather than later.
 	interruption_point();
+	return true;
 }
 catch(const interrupted &e)
 {
 	// Interrupt is stopped here so this ctx can be reused for a new job.
-	return;
+	return true;
 }
 catch(const std::exception &e)
 {
@@ -1623,6 +1793,8 @@ catch(const std::exception &e)
 	// 	ircd::ctx::id(cur()),
 	// 	e.what()
 	// };
+
+	return true;
 }
 
 void
@@ -3299,6 +3471,15 @@ noexcept
 // stack::stack
 //
 
+/// Stacks carved from the huge page arena share huge pages; fewer TLB
+/// entries cover many stacks, but touching any part of a huge page commits
+/// all of it.
+decltype(ircd::ctx::stack::hugepage)
+ircd::ctx::stack::hugepage
+{
+	false
+};
+
 ircd::ctx::stack::stack(const mutable_buffer &buf)
 noexcept
 :buf
@@ -3360,14 +3541,20 @@ ircd::ctx::stack::allocator::allocate(boost::coroutines::stack_context &c,
 		4U * 1024U
 	};
 
-	unique_mutable_buffer umb
+	if(null(buf) && stack::hugepage)
 	{
-		null(buf)? size: 0, alignment
-	};
+		buf = ircd::allocator::hugepage::allocate(size);
+		this->owner = true;
+		this->hugepage = true;
+	}
 
-	if(umb)
+	if(null(buf))
 	{
-		buf = umb.release();
+		buf = mutable_buffer
+		{
+			static_cast<char *>(ircd::allocator::je::arena::ctx_stack.allocate(size, alignment)), size
+		};
+
 		this->owner = true;
 	}
 
@@ -3397,7 +3584,13 @@ noexcept
 		& boolmask<uintptr_t>(owner)
 	};
 
-	std::free(reinterpret_cast<void *>(base));
+	if(hugepage)
+		return ircd::allocator::hugepage::deallocate(mutable_buffer
+		{
+			reinterpret_cast<char *>(base), c.size
+		});
+
+	ircd::allocator::je::arena::ctx_stack.deallocate(reinterpret_cast<void *>(base), c.size);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -13,19 +13,27 @@ namespace ircd::ctx::prof
 	static void mark(const event &);
 }
 
+template<>
+ircd::allocator::slab_pool
+ircd::allocator::slab<ircd::ctx::ctx>::pool;
+
 /// Internal context implementation
 ///
 struct ircd::ctx::ctx
-:instance_list<ctx>
+:allocator::slab_new<ctx>
 {
 	using flags_type = std::underlying_type<context::flags>::type;
 
-	static uint64_t id_ctr;                      // monotonic
+	static std::atomic<uint64_t> id_ctr;         // monotonic
 	static ios::descriptor ios_desc;
-	static ios::handler ios_handler;
-	static ctx *spawning;
-	static dock adjoindre;                       // contexts waiting for join
+	static thread_local ios::handler ios_handler;
+	static thread_local ctx *spawning;
+	static thread_local dock adjoindre;          // contexts waiting for join
+	static thread_local ctx *instances;          // all contexts of this thread
 
+	ctx **registry {&instances};                 // instances list of the owning thread
+	ctx *instance_prev {nullptr};                // registry linkage
+	ctx *instance_next {nullptr};                // registry linkage
 	uint64_t id {++id_ctr};                      // Unique runtime ID
 	char name[16] {0};                           // User given name
 	flags_type flags;                            // User given flags
@@ -38,6 +46,7 @@ struct ircd::ctx::ctx
 	list::node node;                             // node for ctx::list
 	ircd::ctx::stack stack;                      // stack related structure
 	prof::ticker profile;                        // prof related structure
+	allocator::attribution::entry *attribution {nullptr}; // allocation counters
 
 	bool started() const noexcept;               // context was ever entered
 	bool finished() const noexcept;              // context will not be further entered.
@@ -65,7 +74,3 @@ struct ircd::ctx::ctx
 	ctx &operator=(const ctx &) = delete;
 	~ctx() noexcept;
 };
-
-template<>
-decltype(ircd::ctx::ctx::list)
-ircd::util::instance_list<ircd::ctx::ctx>::list;
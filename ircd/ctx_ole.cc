@@ -1,24 +1,141 @@
+#include <RB_INC_DLFCN_H
+#include <RB_INC_SYS_SYSCALL_H
 #include "ctx.h"
 
 namespace ircd::ctx::ole
 {
+	struct task;
+	struct ring;
+	struct completion;
+	struct completions;
+	struct job;
+
+	// Priority classes, in order of precedence.
+	enum prio_class :uint { HIGH, NORMAL, LOW, _NUM_ };
+
 	static const opts default_opts;
 	// extern conf::item<size_t> thread_max;
-	extern size_t thread_max = 1;
 
 	static std::mutex mutex;
 	static std::condition_variable cond;
-	extern std::deque<offload::function> queue;
-	static ssize_t working;
+	extern std::array<ring, prio_class::_NUM_> queue;
+	extern std::array<std::deque<task>, prio_class::_NUM_> overflow;
 	extern std::vector<std::thread> threads;
-	static bool termination alignas(64);
-
-	static offload::function pop();
-	static void push(offload::function &&);
-	static void worker_remove();
-	static void worker() noexcept;
+	static std::atomic<size_t> overflowed;
+	static std::atomic<size_t> thread_count;
+	static size_t retiring;
+	static std::atomic<size_t> takes;
+	static std::atomic<bool> termination alignas(64);
+	static std::atomic<uint32_t> ticket alignas(64);
+	static std::atomic<uint32_t> idle alignas(64);
+
+	extern ios::descriptor completion_desc;
+
+	static std::shared_mutex stats_mutex;
+	extern std::map<std::string, struct stats, std::less<>> stats_map;
+
+	static prio_class classify(const int8_t &prio) noexcept;
+	static struct stats &find_stats(const string_view &name);
+	static bool take(task &, const prio_class &) noexcept;
+	static bool take(task &) noexcept;
+	static task pop();
+	static void push(task &&, const prio_class &);
+	static void spawn();
+	static int pinned_cpu() noexcept;
+	static bool claim() noexcept;
+	static void place(std::thread &, const size_t &);
+	static bool surplus() noexcept;
+	static void worker_remove(const bool &retired);
+	static void worker(const size_t id) noexcept;
 }
 
+/// Notice of a finished offload; the closure is called on the loop thread.
+struct ircd::ctx::ole::completion
+{
+	completion *next {nullptr};
+	void (*func)(completion &) noexcept {nullptr};
+	void *arg {nullptr};
+};
+
+/// State of a submit(); freed by its completion.
+struct ircd::ctx::ole::job
+:allocator::slab_new<job>
+{
+	ole::completion completion;
+	ole::completions *completions {nullptr};
+	std::atomic<size_t> remaining {0};
+	std::function<void ()> work;
+	std::function<void ()> done;
+};
+
+template<>
+ircd::allocator::slab_pool
+ircd::allocator::slab<ircd::ctx::ole::job>::pool
+{
+	"ircd.ctx.ole.job", sizeof(ircd::ctx::ole::job), alignof(ircd::ctx::ole::job)
+};
+
+/// Finished offloads for the contexts of one event loop thread. Workers push
+/// without locking; only a push to an empty list queues a handler, which then
+/// drains every completion pushed until it runs. Under load the loop handles
+/// many completions per epoch rather than one each.
+struct ircd::ctx::ole::completions
+{
+	using executor_type = decltype(ctx::alarm)::executor_type;
+
+	std::atomic<completion *> head {nullptr};
+	executor_type executor;
+
+	static completions &local();
+
+	void drain() noexcept;
+	void push(completion &) noexcept;
+
+	completions(executor_type) noexcept;
+};
+
+/// Queued unit of work.
+struct ircd::ctx::ole::task
+{
+	offload::function func;
+	struct stats *stats {nullptr};
+	uint64_t queued {0};                   // cycles() when pushed
+};
+
+/// Bounded multi-producer multi-consumer queue. Each cell carries a sequence
+/// number which tells producers and consumers whose turn it is to use the
+/// cell; neither side takes a lock (D. Vyukov's bounded MPMC queue).
+struct ircd::ctx::ole::ring
+{
+	struct cell
+	{
+		std::atomic<size_t> seq;
+		ole::task task;
+	};
+
+	static constexpr size_t size {1024};
+	static constexpr size_t mask {size - 1};
+	static_assert((size & mask) == 0);
+
+	alignas(64) std::atomic<size_t> head {0};
+	alignas(64) std::atomic<size_t> tail {0};
+	alignas(64) std::array<cell, size> cells;
+
+  public:
+	bool push(task &) noexcept;
+	bool pop(task &) noexcept;
+
+	ring() noexcept;
+};
+
+/// Maximum number of worker threads; defaults to one per available core.
+/// Workers are started on demand as offloads find the others busy.
+decltype(ircd::ctx::ole::thread_max)
+ircd::ctx::ole::thread_max
+{
+	std::max(std::thread::hardware_concurrency(), 1U)
+};
+
 // decltype(ircd::ctx::ole::thread_max)
 // ircd::ctx::ole::thread_max
 // {
@@ -26,14 +143,78 @@ namespace ircd::ctx::ole
 // 	{ "default",  int64_t(1)                 },
 // };
 
+/// Cores the workers may run on; empty for any.
+decltype(ircd::ctx::ole::cpus)
+ircd::ctx::ole::cpus;
+
+/// Keep workers off the core the event loop which starts them is pinned to
+/// (i.e. ios::shard). Skipped, with a note, when that loop's affinity is not
+/// a single core: it would not stay on whichever core it was on.
+decltype(ircd::ctx::ole::isolate)
+ircd::ctx::ole::isolate
+{
+	false
+};
+
+/// Workers allocate from the NUMA node they are running on (MPOL_LOCAL). That
+/// is the kernel's default already; this only matters when the process was
+/// given another policy (i.e. numactl --interleave) which the workers should
+/// not follow. This pairs with a set of cpus on one node.
+decltype(ircd::ctx::ole::numa_local)
+ircd::ctx::ole::numa_local
+{
+	false
+};
+
+/// Starvation protection: one in this many tasks taken is first sought in
+/// the normal class, ahead of any high priority tasks.
+decltype(ircd::ctx::ole::starve_normal)
+ircd::ctx::ole::starve_normal
+{
+	8
+};
+
+/// Starvation protection: one in this many tasks taken is first sought in
+/// the low class, ahead of any other tasks.
+decltype(ircd::ctx::ole::starve_low)
+ircd::ctx::ole::starve_low
+{
+	64
+};
+
 [[gnu::visibility("internal"), clang::always_destroy]]
 decltype(ircd::ctx::ole::queue)
 ircd::ctx::ole::queue;
 
+/// Tasks which did not fit in their queue; only touched when it is full.
+[[gnu::visibility("internal"), clang::always_destroy]]
+decltype(ircd::ctx::ole::overflow)
+ircd::ctx::ole::overflow;
+
 [[gnu::visibility("internal"), clang::always_destroy]]
 decltype(ircd::ctx::ole::threads)
 ircd::ctx::ole::threads;
 
+[[gnu::visibility("internal"), clang::always_destroy]]
+decltype(ircd::ctx::ole::stats_map)
+ircd::ctx::ole::stats_map;
+
+[[gnu::visibility("internal"), clang::always_destroy]]
+decltype(ircd::ctx::ole::completion_desc)
+ircd::ctx::ole::completion_desc
+{
+	"ircd.ctx.ole.completion"
+};
+
+decltype(ircd::ctx::ole::drain_count)
+ircd::ctx::ole::drain_count;
+
+decltype(ircd::ctx::ole::drain_total)
+ircd::ctx::ole::drain_total;
+
+decltype(ircd::ctx::ole::drain_max)
+ircd::ctx::ole::drain_max;
+
 ircd::ctx::ole::init::init()
 {
 	assert(threads.empty());
@@ -50,7 +231,8 @@ noexcept
 	};
 
 	termination = true;
-	cond.notify_all();
+	ticket.fetch_add(1);
+	ticket.notify_all();
 	cond.wait(lock, []
 	{
 		return threads.empty();
@@ -68,40 +250,61 @@ ircd::ctx::ole::offload::offload(const function &func)
 
 ircd::ctx::ole::offload::offload(const opts &opts,
                                  const function &func)
+:offload
+{
+	opts, [&func](const size_t &rank)
+	{
+		func();
+	}
+}
+{
+}
+
+ircd::ctx::ole::offload::offload(const opts &opts,
+                                 const ranked_function &func)
 {
 	assert(current);
-	assert(opts.concurrency == 1); // not yet implemented
+	assert(opts.concurrency >= 1);
 
 	// Prepare the offload package on our stack here. These objects will
 	// remain here for the duration of the offload.
 	latch latch{1};
+	completion done
+	{
+		nullptr, [](completion &done) noexcept
+		{
+			auto &latch(*static_cast<ircd::ctx::latch *>(done.arg));
+			assert(!latch.is_ready());
+			latch.count_down();
+		},
+		&latch
+	};
 	std::exception_ptr eptr;
-	auto *const context(current);
-	auto closure{[&func, &latch, &eptr, &context]
-	() noexcept
+	std::atomic_flag faulted;
+	std::atomic<size_t> remaining{opts.concurrency};
+	auto &completions(ole::completions::local());
+	const auto closure{[&func, &done, &eptr, &faulted, &remaining, &completions]
+	(const size_t &rank) noexcept
 	{
 		try
 		{
-			func();
+			func(rank);
 		}
 		catch(...)
 		{
 			// Note that the write to eptr is taking place on a different
-			// thread from where we created the eptr.
-			eptr = std::current_exception();
+			// thread from where we created the eptr. Only the first of
+			// several concurrent invocations to fail writes it.
+			if(!faulted.test_and_set(std::memory_order_relaxed))
+				eptr = std::current_exception();
 		}
 
-		// The ctx::signal() is a special device which executes the closure
-		// as soon as the target context is not currently running on any
-		// thread. This has the ability to provide the cross-thread
-		// synchronization we need to hit the latch from this thread.
-		assert(context);
-		signal(*context, [&latch]
-		() noexcept
-		{
-			assert(!latch.is_ready());
-			latch.count_down();
-		});
+		// The last invocation to finish hands the completion to the loop of
+		// the offloading context, which hits the latch from a handler as
+		// ctx::signal() would; this provides the cross-thread synchronization
+		// (including for eptr) we need.
+		if(remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			completions.push(done);
 	}};
 
 	// interrupt(ctx) is suppressed while this context has offloaded some work
@@ -110,7 +313,22 @@ ircd::ctx::ole::offload::offload(const opts &opts,
 	// capable of throwing an interrupt that was received during this scope.
 	const uninterruptible uninterruptible;
 
-	ole::push(std::move(closure));       // scope address required for clang-7
+	auto &stats
+	{
+		find_stats(opts.name)
+	};
+
+	for(size_t rank(0); rank < opts.concurrency; ++rank)
+		ole::push(task
+		{
+			[&closure, rank]
+			{
+				closure(rank);
+			},
+			&stats,
+		},
+		classify(opts.prio));
+
 	latch.wait();
 
 	// Don't throw any exception if there is a pending interrupt for this ctx.
@@ -120,55 +338,239 @@ ircd::ctx::ole::offload::offload(const opts &opts,
 		if(unlikely(eptr))
 			std::rethrow_exception(eptr);
 }
+
+/// Queue work without waiting for it. After all opts::concurrency
+/// invocations of work have returned, done is called on the event loop of
+/// the calling context. Neither should throw.
+void
+ircd::ctx::ole::submit(const opts &opts,
+                       std::function<void ()> work,
+                       std::function<void ()> done)
+{
+	assert(current);
+	assert(opts.concurrency >= 1);
+	auto job
+	{
+		std::make_unique<ole::job>()
+	};
+
+	job->completions = &completions::local();
+	job->remaining = opts.concurrency;
+	job->work = std::move(work);
+	job->done = std::move(done);
+	job->completion.arg = job.get();
+	job->completion.func = [](completion &completion) noexcept
+	{
+		const std::unique_ptr<ole::job> job
+		{
+			static_cast<ole::job *>(completion.arg)
+		};
+
+		try
+		{
+			job->done();
+		}
+		catch(const std::exception &e)
+		{
+			assert(false);
+		}
+	};
+
+	auto &stats
+	{
+		find_stats(opts.name)
+	};
+
+	auto *const ptr(job.release());
+	for(size_t rank(0); rank < opts.concurrency; ++rank)
+		ole::push(task
+		{
+			[ptr]
+			{
+				ptr->work();
+				if(ptr->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					ptr->completions->push(ptr->completion);
+			},
+			&stats,
+		},
+		classify(opts.prio));
+}
+
+void
+ircd::ctx::ole::push(task &&task,
+                     const prio_class &prio)
+{
+	assert(task.stats);
+	auto &stats(*task.stats);
+	const auto queued(stats.queued.fetch_add(1) + 1);
+	if(queued > stats.queued_max.load(std::memory_order_relaxed))
+		stats.queued_max.store(queued, std::memory_order_relaxed);
+
+	task.queued = ircd::prof::cycles();
+	if(unlikely(!queue[prio].push(task)))
+	{
+		const std::lock_guard lock
+		{
+			mutex
+		};
+
+		overflow[prio].emplace_back(std::move(task));
+		overflowed.fetch_add(1);
+	}
+
+	// Advancing the ticket after the task is visible ensures a worker going
+	// idle either sees the task or has its wait fall through. An idle worker
+	// is claimed for the task so the next push does not count it again and
+	// spawns instead; only when none can be claimed or spawned is a waiter
+	// woken regardless, in case the count missed one.
+	ticket.fetch_add(1);
+	if(claim())
+		ticket.notify_one();
+	else if(thread_count.load(std::memory_order_relaxed) < thread_max)
+		spawn();
+	else
+		ticket.notify_one();
+}
+
+/// Takes one from the idle count; false if there were none.
+bool
+ircd::ctx::ole::claim()
+noexcept
+{
+	auto waiting(idle.load());
+	while(waiting && !idle.compare_exchange_weak(waiting, waiting - 1));
+	return waiting;
+}
+
 void
-ircd::ctx::ole::push(offload::function &&func)
+ircd::ctx::ole::spawn()
 {
 	const std::lock_guard lock
 	{
 		mutex
 	};
 
-	assert(working >= 0);
-	const bool need_thread
+	if(unlikely(termination))
+		return;
+
+	if(threads.size() - retiring >= thread_max)
+		return;
+
+	const posix::enable_pthread enable_pthread;
+	const size_t id(threads.size());
+	threads.emplace_back(&worker, id);
+	thread_count.store(threads.size() - retiring, std::memory_order_relaxed);
+	place(threads.back(), id);
+}
+
+/// Name the worker and set its affinity. This is called on the loop thread
+/// starting the worker.
+void
+ircd::ctx::ole::place(std::thread &thread,
+                      const size_t &id)
+{
+	// The real pthread_setname_np(3) rather than ctx::posix's, so the name is
+	// seen by the kernel for top -H, perf, etc.
+	using setname_proto = int (pthread_t, const char *);
+	static const auto setname
 	{
-		threads.empty()
-		|| threads.size() == size_t(working)
+		reinterpret_cast<setname_proto *>(::dlsym(RTLD_NEXT, "pthread_setname_np"))
 	};
 
-	const bool add_thread
+	char name[16];
+	::snprintf(name, sizeof(name), "ole %zu", id);
+	if(likely(setname))
+		setname(thread.native_handle(), name);
+
+	if(cpus.empty() && !isolate)
+		return;
+
+	// Without cpus, start from the main thread's mask rather than the calling
+	// thread's; the latter is just the one core when the loop is pinned.
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(cpus.empty())
+		::sched_getaffinity(::getpid(), sizeof(set), &set);
+
+	for(const auto &cpu : cpus)
+		CPU_SET(cpu, &set);
+
+	const int loop_cpu
 	{
-		need_thread
-		&& threads.size() < size_t(thread_max)
+		isolate? pinned_cpu(): -1
 	};
 
-	if(unlikely(add_thread))
-	{
-		++working; // pre-increment under lock here
+	if(loop_cpu >= 0)
+		CPU_CLR(loop_cpu, &set);
 
-		const posix::enable_pthread enable_pthread;
-		threads.emplace_back(&worker);
+	// The main thread may be pinned to the loop's core as well.
+	if(cpus.empty() && loop_cpu >= 0 && CPU_COUNT(&set) == 0)
+	{
+		const long online(::sysconf(_SC_NPROCESSORS_ONLN));
+		for(long cpu(0); cpu < online && cpu < CPU_SETSIZE; ++cpu)
+			if(cpu != loop_cpu)
+				CPU_SET(cpu, &set);
 	}
 
-	queue.emplace_back(std::move(func));
-	cond.notify_all();
+	if(CPU_COUNT(&set) > 0)
+		::pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+}
+
+/// The one core the calling thread's affinity allows; -1 if it allows more.
+int
+ircd::ctx::ole::pinned_cpu()
+noexcept
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(::sched_getaffinity(0, sizeof(set), &set) == 0)
+		if(CPU_COUNT(&set) == 1)
+			for(int cpu(0); cpu < CPU_SETSIZE; ++cpu)
+				if(CPU_ISSET(cpu, &set))
+					return cpu;
+
+	static bool noted;
+	if(!std::exchange(noted, true))
+		fprintf(stderr, "ole: isolate skipped; the loop thread is not pinned to one core\n");
+
+	return -1;
 }
 
 void
-ircd::ctx::ole::worker()
+ircd::ctx::ole::worker(const size_t id)
 noexcept
 {
-	while(!termination) try
+	// MPOL_LOCAL of linux/mempolicy.h: allocate on the node of the cpu.
+	constexpr int mpol_local {4};
+	if(numa_local)
+		::syscall(SYS_set_mempolicy, mpol_local, nullptr, 0UL);
+
+	bool retired(false);
+	while(!termination.load(std::memory_order_relaxed)) try
 	{
-		const auto func
+		if(unlikely(thread_count.load(std::memory_order_relaxed) > thread_max))
+			if((retired = surplus()))
+				break;
+
+		const auto task
 		{
 			pop()
 		};
 
-		func();
-	}
-	catch(const interrupted &)
-	{
-		break;
+		// Empty on termination, or for a surplus worker to retire.
+		if(!task.func)
+			continue;
+
+		assert(task.stats);
+		auto &stats(*task.stats);
+		const auto waited(ircd::prof::cycles() - task.queued);
+		stats.queued.fetch_sub(1, std::memory_order_relaxed);
+		stats.count.fetch_add(1, std::memory_order_relaxed);
+		stats.wait_total.fetch_add(waited, std::memory_order_relaxed);
+		if(waited > stats.wait_max.load(std::memory_order_relaxed))
+			stats.wait_max.store(waited, std::memory_order_relaxed);
+
+		task.func();
 	}
 	catch(const std::exception &e)
 	{
@@ -176,11 +578,29 @@ noexcept
 		continue;
 	}
 
-	worker_remove();
+	worker_remove(retired);
+}
+
+/// Claims the exit of one worker beyond thread_max for the caller.
+bool
+ircd::ctx::ole::surplus()
+noexcept
+{
+	const std::lock_guard lock
+	{
+		mutex
+	};
+
+	if(threads.size() - retiring <= thread_max)
+		return false;
+
+	++retiring;
+	thread_count.store(threads.size() - retiring, std::memory_order_relaxed);
+	return true;
 }
 
 void
-ircd::ctx::ole::worker_remove()
+ircd::ctx::ole::worker_remove(const bool &retired)
 {
 	const std::lock_guard lock
 	{
@@ -200,34 +620,326 @@ ircd::ctx::ole::worker_remove()
 	auto &this_thread(*it);
 	this_thread.detach();
 	threads.erase(it);
+	retiring -= retired;
+	thread_count.store(threads.size() - retiring, std::memory_order_relaxed);
 	cond.notify_all();
 }
 
-ircd::ctx::ole::offload::function
+/// Wait for the next task; returns an empty task on termination. The wait
+/// is on the ticket word, which is a futex(2) with std::atomic::wait.
+ircd::ctx::ole::task
 ircd::ctx::ole::pop()
 {
-	std::unique_lock lock
+	task task;
+	while(!take(task))
+	{
+		const auto last
+		{
+			ticket.load()
+		};
+
+		// Announce before checking again so a push either finds us idle or
+		// we find its task.
+		idle.fetch_add(1);
+		const bool taken
+		{
+			take(task)
+		};
+
+		// Nothing is thrown here; exceptions are not safe to construct this
+		// late in static destruction when the workers are terminated.
+		if(!taken && !termination.load())
+			ticket.wait(last);
+
+		// Unless a push claimed this worker already.
+		claim();
+		if(taken)
+			break;
+
+		if(unlikely(termination.load()))
+			return {};
+
+		if(unlikely(thread_count.load(std::memory_order_relaxed) > thread_max))
+			return {};
+	}
+
+	return task;
+}
+
+/// Take from the highest class with work, except the starvation protection
+/// periodically looks at a lower class first.
+bool
+ircd::ctx::ole::take(task &task)
+noexcept
+{
+	const auto n
+	{
+		takes.load(std::memory_order_relaxed) + 1
+	};
+
+	const prio_class first
+	{
+		starve_low && n % starve_low == 0?
+			prio_class::LOW:
+		starve_normal && n % starve_normal == 0?
+			prio_class::NORMAL:
+			prio_class::HIGH
+	};
+
+	bool taken
+	{
+		first != prio_class::HIGH && take(task, first)
+	};
+
+	for(uint prio(0); prio < prio_class::_NUM_ && !taken; ++prio)
+		taken = take(task, prio_class(prio));
+
+	takes.fetch_add(taken, std::memory_order_relaxed);
+	return taken;
+}
+
+bool
+ircd::ctx::ole::take(task &task,
+                     const prio_class &prio)
+noexcept
+{
+	if(likely(queue[prio].pop(task)))
+		return true;
+
+	if(likely(!overflowed.load(std::memory_order_relaxed)))
+		return false;
+
+	const std::lock_guard lock
 	{
 		mutex
 	};
 
-	--working;
-	assert(working >= 0);
-	cond.wait(lock, []
+	if(overflow[prio].empty())
+		return false;
+
+	task = std::move(overflow[prio].front());
+	overflow[prio].pop_front();
+	overflowed.fetch_sub(1);
+	return true;
+}
+
+ircd::ctx::ole::prio_class
+ircd::ctx::ole::classify(const int8_t &prio)
+noexcept
+{
+	return
+		prio < 0? prio_class::HIGH:
+		prio > 0? prio_class::LOW:
+		          prio_class::NORMAL;
+}
+
+//
+// stats
+//
+
+size_t
+ircd::ctx::ole::workers()
+noexcept
+{
+	return thread_count.load(std::memory_order_relaxed);
+}
+
+/// Wakes the idle workers so those beyond thread_max exit; busy workers exit
+/// after their task. For after thread_max is lowered.
+void
+ircd::ctx::ole::retire()
+noexcept
+{
+	ticket.fetch_add(1);
+	ticket.notify_all();
+}
+
+bool
+ircd::ctx::ole::for_each(const std::function<bool (const string_view &, const stats &)> &closure)
+{
+	const std::shared_lock lock
 	{
-		return !queue.empty() || termination;
-	});
+		stats_mutex
+	};
 
-	if(unlikely(termination))
-		throw interrupted{};
+	for(const auto &[name, stats] : stats_map)
+		if(!closure(name, stats))
+			return false;
 
-	auto function
+	return true;
+}
+
+/// Entries are never removed, so the reference remains valid.
+struct ircd::ctx::ole::stats &
+ircd::ctx::ole::find_stats(const string_view &name)
+{
 	{
-		std::move(queue.front())
+		const std::shared_lock lock
+		{
+			stats_mutex
+		};
+
+		const auto it(stats_map.find(name));
+		if(likely(it != end(stats_map)))
+			return it->second;
+	}
+
+	const std::unique_lock lock
+	{
+		stats_mutex
+	};
+
+	return stats_map.try_emplace(std::string(name)).first->second;
+}
+
+//
+// completions
+//
+
+/// The completion list of the calling context's event loop thread.
+ircd::ctx::ole::completions &
+ircd::ctx::ole::completions::local()
+{
+	thread_local std::unique_ptr<completions> local;
+	if(unlikely(!local))
+	{
+		assert(current);
+		local = std::make_unique<completions>(current->alarm.get_executor());
+	}
+
+	return *local;
+}
+
+ircd::ctx::ole::completions::completions(executor_type executor)
+noexcept
+:executor
+{
+	std::move(executor)
+}
+{
+}
+
+/// Called on a worker thread.
+void
+ircd::ctx::ole::completions::push(completion &done)
+noexcept
+{
+	completion *prev
+	{
+		head.load(std::memory_order_relaxed)
 	};
 
-	queue.pop_front();
-	++working;
-	assert(working > 0);
-	return function;
+	do done.next = prev;
+	while(!head.compare_exchange_weak(prev, &done, std::memory_order_release, std::memory_order_relaxed));
+
+	// The offloading context may be gone by now but this list is not.
+	if(!prev)
+		boost::asio::post(executor, ios::handle
+		{
+			completion_desc, [this]
+			{
+				drain();
+			}
+		});
+}
+
+/// Called on the loop thread.
+void
+ircd::ctx::ole::completions::drain()
+noexcept
+{
+	completion *done
+	{
+		head.exchange(nullptr, std::memory_order_acquire)
+	};
+
+	uint64_t count(0);
+	while(done)
+	{
+		// The completion may be destroyed by its closure.
+		auto *const next(done->next);
+		assert(done->func);
+		done->func(*done);
+		done = next;
+		++count;
+	}
+
+	drain_count.fetch_add(1, std::memory_order_relaxed);
+	drain_total.fetch_add(count, std::memory_order_relaxed);
+	if(count > drain_max.load(std::memory_order_relaxed))
+		drain_max.store(count, std::memory_order_relaxed);
+}
+
+//
+// ring
+//
+
+ircd::ctx::ole::ring::ring()
+noexcept
+{
+	for(size_t i(0); i < size; ++i)
+		cells[i].seq.store(i, std::memory_order_relaxed);
+}
+
+/// Moves from the argument only on success; false when full.
+bool
+ircd::ctx::ole::ring::push(task &task)
+noexcept
+{
+	size_t pos
+	{
+		head.load(std::memory_order_relaxed)
+	};
+
+	for(;;)
+	{
+		auto &cell(cells[pos & mask]);
+		const auto seq(cell.seq.load(std::memory_order_acquire));
+		const auto dif(ssize_t(seq) - ssize_t(pos));
+		if(dif == 0)
+		{
+			if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				cell.task = std::move(task);
+				cell.seq.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if(dif < 0)
+			return false;
+		else
+			pos = head.load(std::memory_order_relaxed);
+	}
+}
+
+/// False when empty.
+bool
+ircd::ctx::ole::ring::pop(task &task)
+noexcept
+{
+	size_t pos
+	{
+		tail.load(std::memory_order_relaxed)
+	};
+
+	for(;;)
+	{
+		auto &cell(cells[pos & mask]);
+		const auto seq(cell.seq.load(std::memory_order_acquire));
+		const auto dif(ssize_t(seq) - ssize_t(pos + 1));
+		if(dif == 0)
+		{
+			if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				task = std::move(cell.task);
+				cell.task = {};
+				cell.seq.store(pos + size, std::memory_order_release);
+				return true;
+			}
+		}
+		else if(dif < 0)
+			return false;
+		else
+			pos = tail.load(std::memory_order_relaxed);
+	}
 }
@@ -0,0 +1,316 @@
+#include <RB_INC_FCNTL_H
+#include <RB_INC_SYS_STAT_H
+#include <RB_INC_SYS_UIO_H
+
+namespace ircd::fs
+{
+	template<class F> static auto call(const op &, const string_view &name, F&&);
+
+	static std::array<stats, size_t(op::_NUM_)> opstat;
+}
+
+const ircd::fs::stats &
+ircd::fs::opstats(const op &op)
+noexcept
+{
+	assert(op < op::_NUM_);
+	return opstat.at(size_t(op));
+}
+
+/// Makes the system call(s) in func on a worker and accounts for it under
+/// op; func returns the number of bytes transferred or throws.
+template<class F>
+auto
+ircd::fs::call(const op &op,
+               const string_view &name,
+               F&& func)
+{
+	auto &stats(opstat.at(size_t(op)));
+	const auto started
+	{
+		ircd::prof::cycles()
+	};
+
+	const unwind account{[&stats, &started]
+	{
+		const auto took
+		{
+			ircd::prof::cycles() - started
+		};
+
+		auto max(stats.time_max.load(std::memory_order_relaxed));
+		while(took > max && !stats.time_max.compare_exchange_weak(max, took, std::memory_order_relaxed));
+		stats.time_total.fetch_add(took, std::memory_order_relaxed);
+		stats.count.fetch_add(1, std::memory_order_relaxed);
+	}};
+
+	const unwind_exceptional error{[&stats]
+	{
+		stats.errors.fetch_add(1, std::memory_order_relaxed);
+	}};
+
+	decltype(func()) ret {};
+	if(likely(ctx::current))
+	{
+		ctx::ole::opts opts;
+		opts.name = name;
+		ctx::offload
+		{
+			opts, [&ret, &func]
+			{
+				ret = func();
+			}
+		};
+	}
+	else ret = func();
+
+	if constexpr(std::is_same_v<decltype(ret), size_t>)
+		stats.bytes.fetch_add(ret, std::memory_order_relaxed);
+
+	return ret;
+}
+
+ircd::mutable_buffer
+ircd::fs::read(const fd &fd,
+               const mutable_buffer &buf)
+{
+	const size_t ret
+	{
+		call(op::READ, "ircd.fs.read", [&fd, &buf]
+		{
+			size_t ret(0);
+			while(ret < size(buf))
+			{
+				const auto r
+				{
+					::read(fd, data(buf) + ret, size(buf) - ret)
+				};
+
+				if(r < 0 && errno == EINTR)
+					continue;
+
+				if(r < 0)
+					throw_system_error(errno);
+
+				if(r == 0)
+					break;
+
+				ret += r;
+			}
+
+			return ret;
+		})
+	};
+
+	return mutable_buffer
+	{
+		data(buf), ret
+	};
+}
+
+ircd::mutable_buffer
+ircd::fs::pread(const fd &fd,
+                const mutable_buffer &buf,
+                const off_t &offset)
+{
+	const size_t ret
+	{
+		call(op::READ, "ircd.fs.read", [&fd, &buf, &offset]
+		{
+			size_t ret(0);
+			while(ret < size(buf))
+			{
+				const auto r
+				{
+					::pread(fd, data(buf) + ret, size(buf) - ret, offset + ret)
+				};
+
+				if(r < 0 && errno == EINTR)
+					continue;
+
+				if(r < 0)
+					throw_system_error(errno);
+
+				if(r == 0)
+					break;
+
+				ret += r;
+			}
+
+			return ret;
+		})
+	};
+
+	return mutable_buffer
+	{
+		data(buf), ret
+	};
+}
+
+ircd::const_buffer
+ircd::fs::write(const fd &fd,
+                const const_buffer &buf)
+{
+	call(op::WRITE, "ircd.fs.write", [&fd, &buf]
+	{
+		size_t ret(0);
+		while(ret < size(buf))
+		{
+			const auto r
+			{
+				::write(fd, data(buf) + ret, size(buf) - ret)
+			};
+
+			if(r < 0 && errno == EINTR)
+				continue;
+
+			if(r < 0)
+				throw_system_error(errno);
+
+			// No progress on a non-empty write would loop forever.
+			if(unlikely(r == 0))
+				throw_system_error(EIO);
+
+			ret += r;
+		}
+
+		return ret;
+	});
+
+	return buf;
+}
+
+size_t
+ircd::fs::write(const fd &fd,
+                const vector_view<const const_buffer> &bufs)
+{
+	return call(op::WRITE, "ircd.fs.write", [&fd, &bufs]
+	{
+		size_t ret(0), i(0);
+		while(i < bufs.size())
+		{
+			iov<64> list;
+			for(; i < bufs.size() && list.size() < 64; ++i)
+				list.append(bufs[i]);
+
+			while(!list.empty())
+			{
+				const iov<64>::as<struct ::iovec> vec
+				{
+					list
+				};
+
+				const auto r
+				{
+					::writev(fd, vec.data(), vec.size())
+				};
+
+				if(r < 0 && errno == EINTR)
+					continue;
+
+				if(r < 0)
+					throw_system_error(errno);
+
+				// Empty buffers are never appended, so nothing written is
+				// no progress.
+				if(unlikely(r == 0))
+					throw_system_error(EIO);
+
+				ret += list.consume(r);
+			}
+		}
+
+		return ret;
+	});
+}
+
+/// Without metadata only fdatasync(2) is made.
+void
+ircd::fs::fsync(const fd &fd,
+                const bool &metadata)
+{
+	call(op::SYNC, "ircd.fs.sync", [&fd, &metadata]
+	{
+		const auto r
+		{
+			metadata? ::fsync(fd): ::fdatasync(fd)
+		};
+
+		if(r < 0)
+			throw_system_error(errno);
+
+		return 0UL;
+	});
+}
+
+void
+ircd::fs::fallocate(const fd &fd,
+                    const off_t &offset,
+                    const size_t &length,
+                    const int &mode)
+{
+	call(op::ALLOCATE, "ircd.fs.allocate", [&fd, &offset, &length, &mode]
+	{
+		if(::fallocate(fd, mode, offset, length) < 0)
+			throw_system_error(errno);
+
+		return 0UL;
+	});
+}
+
+//
+// fd
+//
+
+ircd::fs::fd::fd(const string_view &path,
+                 const int &flags,
+                 const mode_t &mode)
+:fdno
+{
+	call(op::OPEN, "ircd.fs.open", [&path, &flags, &mode]
+	{
+		const std::string p(path);
+		const int ret
+		{
+			::open(p.c_str(), flags | O_CLOEXEC, mode)
+		};
+
+		if(ret < 0)
+			throw_system_error(errno);
+
+		return ret;
+	})
+}
+{
+}
+
+ircd::fs::fd::fd(fd &&other)
+noexcept
+:fdno
+{
+	std::exchange(other.fdno, -1)
+}
+{
+}
+
+ircd::fs::fd &
+ircd::fs::fd::operator=(fd &&other)
+noexcept
+{
+	if(likely(this != &other))
+	{
+		if(fdno >= 0)
+			::close(fdno);
+
+		fdno = std::exchange(other.fdno, -1);
+	}
+
+	return *this;
+}
+
+ircd::fs::fd::~fd()
+noexcept
+{
+	if(fdno >= 0)
+		::close(fdno);
+}
@@ -1,3 +1,5 @@
+#include <RB_INC_EXECINFO_H
+
 /// Logging facility
 // decltype(ircd::ios::log)
 // ircd::ios::log
@@ -77,6 +79,9 @@ ircd::ios::init(asio::executor &&user)
 	// Set the reference handle to our executor.
 	ios::main = *ios::primary;
 	ios::main_available = bool(ios::main);
+
+	// The main loop is a reader of qsbr-protected structures.
+	static qsbr::reader main_reader;
 }
 
 [[using gnu: cold]]
@@ -180,6 +185,590 @@ ircd::ios::forked_parent()
 	#endif
 }
 
+//
+// shard
+//
+
+namespace ircd::ios
+{
+	extern descriptor shard_fault_desc;
+}
+
+decltype(ircd::ios::shard::list)
+ircd::ios::shard::list;
+
+decltype(ircd::ios::shard::current)
+thread_local
+ircd::ios::shard::current;
+
+void
+ircd::ios::shard::start(const opts &opts)
+{
+	assert(list.empty());
+	assert(main_available);
+
+	const uint cores
+	{
+		std::max(std::thread::hardware_concurrency(), 1U)
+	};
+
+	const size_t count
+	{
+		opts.count?: std::max(cores - std::min(opts.cpu, cores), 1U)
+	};
+
+	list.reserve(count);
+	for(size_t i(0); i < count; ++i)
+	{
+		const int cpu
+		{
+			opts.pin? int((opts.cpu + i) % cores): -1
+		};
+
+		list.emplace_back(std::make_unique<shard>(i, cpu));
+	}
+}
+
+[[gnu::cold]]
+void
+ircd::ios::shard::stop()
+noexcept
+{
+	list.clear();
+}
+
+ircd::ios::shard::shard(const uint &id,
+                        const int &cpu)
+:id
+{
+	id
+}
+,cpu
+{
+	cpu
+}
+,context
+{
+	std::make_unique<asio::io_context>(1)
+}
+,executor
+{
+	std::make_unique<asio::executor>(context->get_executor())
+}
+{
+	const ctx::posix::enable_pthread enable_pthread;
+	thread = std::thread
+	{
+		&shard::run, this
+	};
+
+	if(cpu < 0)
+		return;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	::pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+}
+
+ircd::ios::shard::~shard()
+noexcept
+{
+	context->stop();
+	if(thread.joinable())
+		thread.join();
+}
+
+void
+ircd::ios::shard::run()
+noexcept
+{
+	const scope_restore current
+	{
+		shard::current, this
+	};
+
+	const qsbr::reader reader;
+
+	// The loop runs until stop(); without this guard it would return as soon
+	// as the shard has nothing queued.
+	const auto work
+	{
+		asio::make_work_guard(*context)
+	};
+
+	while(!context->stopped()) try
+	{
+		context->run();
+	}
+	catch(...)
+	{
+		++faults;
+		const auto eptr(std::current_exception());
+		fprintf(stderr, "ios::shard %u handler fault :%s\n", id, what(eptr).data());
+		::fflush(stderr);
+
+		// Rethrown on the main loop so it propagates out of ios::main's
+		// run() like any exception from a handler there.
+		if(likely(main_available))
+			boost::asio::post(ios::main, handle
+			{
+				shard_fault_desc, [eptr]
+				{
+					std::rethrow_exception(eptr);
+				}
+			});
+	}
+}
+
+//
+// qsbr
+//
+
+namespace ircd::ios::qsbr
+{
+	struct retiree;
+
+	static std::mutex mutex;
+	static std::vector<reader *> readers;
+	static std::deque<retiree> retirees;
+}
+
+/// Object awaiting every reader to have seen the epoch it was retired at.
+struct ircd::ios::qsbr::retiree
+{
+	uint64_t epoch;
+	std::function<void ()> reclaim;
+};
+
+decltype(ircd::ios::qsbr::reader::current)
+thread_local
+ircd::ios::qsbr::reader::current;
+
+decltype(ircd::ios::qsbr::epoch)
+ircd::ios::qsbr::epoch;
+
+decltype(ircd::ios::qsbr::pending)
+ircd::ios::qsbr::pending;
+
+decltype(ircd::ios::qsbr::retired)
+ircd::ios::qsbr::retired;
+
+decltype(ircd::ios::qsbr::reclaimed)
+ircd::ios::qsbr::reclaimed;
+
+/// Schedule the closure to run after all readers have passed a quiescent
+/// state. The caller must have already unpublished the object.
+void
+ircd::ios::qsbr::retire(std::function<void ()> closure)
+{
+	{
+		const std::lock_guard lock
+		{
+			mutex
+		};
+
+		// Advancing the epoch under the lock keeps retirees in order.
+		const auto retired_at
+		{
+			epoch.fetch_add(1, std::memory_order_seq_cst) + 1
+		};
+
+		retirees.emplace_back(retiree
+		{
+			retired_at, std::move(closure)
+		});
+
+		++retired;
+		pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// The caller's own reader is not advanced: it may still hold what it
+	// retired until its handler leaves.
+	reclaim();
+}
+
+/// Free what all readers are done with; returns the number freed. Does
+/// nothing if another thread is already reclaiming.
+size_t
+ircd::ios::qsbr::reclaim()
+noexcept
+{
+	std::unique_lock lock
+	{
+		mutex, std::try_to_lock
+	};
+
+	if(!lock.owns_lock())
+		return 0;
+
+	const auto seen
+	{
+		std::accumulate(begin(readers), end(readers), UINT64_MAX, []
+		(const uint64_t &ret, const reader *const reader)
+		{
+			return std::min(ret, reader->seen.load(std::memory_order_seq_cst));
+		})
+	};
+
+	std::vector<retiree> ready;
+	while(!retirees.empty() && retirees.front().epoch <= seen)
+	{
+		ready.emplace_back(std::move(retirees.front()));
+		retirees.pop_front();
+	}
+
+	reclaimed += ready.size();
+	pending.fetch_sub(ready.size(), std::memory_order_relaxed);
+	lock.unlock();
+
+	for(auto &retiree : ready)
+		retiree.reclaim();
+
+	return ready.size();
+}
+
+/// The calling thread will not read until online(); it no longer holds up
+/// reclamation. For readers about to block.
+void
+ircd::ios::qsbr::offline()
+noexcept
+{
+	if(reader::current)
+		reader::current->seen.store(UINT64_MAX, std::memory_order_release);
+}
+
+void
+ircd::ios::qsbr::online()
+noexcept
+{
+	if(reader::current)
+		reader::current->seen.store(epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+}
+
+//
+// reader::reader
+//
+
+ircd::ios::qsbr::reader::reader()
+noexcept
+:seen
+{
+	epoch.load(std::memory_order_acquire)
+}
+{
+	assert(!current);
+	const std::lock_guard lock
+	{
+		mutex
+	};
+
+	readers.emplace_back(this);
+	current = this;
+}
+
+ircd::ios::qsbr::reader::~reader()
+noexcept
+{
+	assert(current == this);
+	{
+		const std::lock_guard lock
+		{
+			mutex
+		};
+
+		readers.erase(std::find(begin(readers), end(readers), this));
+		current = nullptr;
+	}
+
+	reclaim();
+}
+
+//
+// watchdog
+//
+
+namespace ircd::ios::watchdog
+{
+	struct target;
+
+	static void handle_signal(int) noexcept;
+	static void record(const target &, std::unique_lock<std::mutex> &, const uint64_t &, const milliseconds &);
+	static void worker(const target) noexcept;
+
+	static std::mutex mutex;
+	static std::condition_variable cond;
+	static std::thread thread;
+	static bool termination;
+	static std::array<stall, 16> ring;
+	static stall pending;
+	static std::atomic<stall *> tracing;
+	static std::atomic<bool> traced;
+	static struct ::sigaction previous;
+}
+
+/// The loop thread being watched. The addresses of its thread_local state
+/// are taken on that thread and sampled from the watchdog thread.
+struct ircd::ios::watchdog::target
+{
+	pthread_t thread;
+	const uint64_t *epoch;
+	ios::handler *const *current;
+};
+
+decltype(ircd::ios::watchdog::interval)
+ircd::ios::watchdog::interval
+{
+	50
+};
+
+decltype(ircd::ios::watchdog::threshold)
+ircd::ios::watchdog::threshold
+{
+	250
+};
+
+decltype(ircd::ios::watchdog::signum)
+ircd::ios::watchdog::signum
+{
+	SIGURG
+};
+
+decltype(ircd::ios::watchdog::stalls)
+ircd::ios::watchdog::stalls;
+
+/// Start watching the calling thread's event loop.
+[[gnu::cold]]
+void
+ircd::ios::watchdog::start()
+{
+	assert(!running());
+
+	// The real pthread_self(3) rather than the ctx::posix emulation when
+	// called from a context.
+	const ctx::posix::enable_pthread enable_pthread;
+	const target target
+	{
+		::pthread_self(),
+		&handler::epoch,
+		&handler::current,
+	};
+
+	struct ::sigaction sa {0};
+	sa.sa_handler = handle_signal;
+	sa.sa_flags = SA_RESTART;
+	::sigemptyset(&sa.sa_mask);
+	::sigaction(signum, &sa, &previous);
+
+	// The first call to backtrace(3) may allocate and load libgcc; it must
+	// not happen in the signal handler.
+	void *warm[1];
+	::backtrace(warm, 1);
+
+	termination = false;
+	thread = std::thread
+	{
+		&worker, target
+	};
+}
+
+[[gnu::cold]]
+void
+ircd::ios::watchdog::stop()
+noexcept
+{
+	if(!running())
+		return;
+
+	{
+		const std::lock_guard lock
+		{
+			mutex
+		};
+
+		termination = true;
+		cond.notify_all();
+	}
+
+	thread.join();
+	::sigaction(signum, &previous, nullptr);
+}
+
+bool
+ircd::ios::watchdog::running()
+noexcept
+{
+	return thread.joinable();
+}
+
+/// Iterate the recorded stalls, most recent first.
+bool
+ircd::ios::watchdog::for_each(const std::function<bool (const stall &)> &closure)
+{
+	const std::lock_guard lock
+	{
+		mutex
+	};
+
+	const size_t count
+	{
+		std::min(stalls, uint64_t(ring.size()))
+	};
+
+	for(size_t i(0); i < count; ++i)
+		if(!closure(ring[(stalls - 1 - i) % ring.size()]))
+			return false;
+
+	return true;
+}
+
+void
+ircd::ios::watchdog::worker(const target target)
+noexcept
+{
+	uint64_t last
+	{
+		__atomic_load_n(target.epoch, __ATOMIC_RELAXED)
+	};
+
+	uint64_t reported
+	{
+		0
+	};
+
+	auto since
+	{
+		std::chrono::steady_clock::now()
+	};
+
+	std::unique_lock lock
+	{
+		mutex
+	};
+
+	while(!cond.wait_for(lock, interval, []
+	{
+		return termination;
+	}))
+	{
+		const auto epoch
+		{
+			__atomic_load_n(target.epoch, __ATOMIC_RELAXED)
+		};
+
+		const auto now
+		{
+			std::chrono::steady_clock::now()
+		};
+
+		// No handler is executing when the loop is waiting for events; the
+		// epoch is not expected to advance then.
+		const bool executing
+		{
+			__atomic_load_n(target.current, __ATOMIC_RELAXED) != nullptr
+		};
+
+		if(epoch != last || !executing)
+		{
+			last = epoch;
+			since = now;
+			continue;
+		}
+
+		const auto duration
+		{
+			std::chrono::duration_cast<milliseconds>(now - since)
+		};
+
+		if(duration < threshold)
+			continue;
+
+		// The stall already recorded is still ongoing; update its duration.
+		if(epoch == reported)
+		{
+			assert(stalls);
+			ring[(stalls - 1) % ring.size()].duration = duration;
+			continue;
+		}
+
+		reported = epoch;
+		record(target, lock, epoch, duration);
+	}
+}
+
+/// The names are copied by the loop thread in the signal handler along with
+/// its backtrace, while the handler and context are still current there; the
+/// watchdog can't dereference them itself as they may be gone by then. The
+/// lock is released while waiting for the loop thread.
+void
+ircd::ios::watchdog::record(const target &target,
+                            std::unique_lock<std::mutex> &lock,
+                            const uint64_t &epoch,
+                            const milliseconds &duration)
+{
+	// Have the loop thread trace itself; wait a bounded time for it.
+	pending = {};
+	traced.store(false, std::memory_order_relaxed);
+	tracing.store(&pending, std::memory_order_release);
+	lock.unlock();
+	if(::pthread_kill(target.thread, signum) == 0)
+		for(size_t i(0); i < 100 && !traced.load(std::memory_order_acquire); ++i)
+			std::this_thread::sleep_for(milliseconds(1));
+
+	tracing.store(nullptr, std::memory_order_release);
+	lock.lock();
+
+	auto &stall
+	{
+		ring[stalls % ring.size()]
+	};
+
+	stall = {};
+	stall.epoch = epoch;
+	stall.duration = duration;
+
+	// Whatever the loop is running now is only the stall's if it has not
+	// moved on since it was sampled.
+	if(traced.load(std::memory_order_acquire) && pending.epoch == epoch)
+	{
+		std::memcpy(stall.descriptor, pending.descriptor, sizeof(stall.descriptor));
+		std::memcpy(stall.context, pending.context, sizeof(stall.context));
+		stall.context_id = pending.context_id;
+		stall.frames = pending.frames;
+		stall.backtrace = pending.backtrace;
+	}
+
+	++stalls;
+}
+
+void
+ircd::ios::watchdog::handle_signal(int)
+noexcept
+{
+	const auto stall
+	{
+		tracing.load(std::memory_order_acquire)
+	};
+
+	if(!stall)
+		return;
+
+	const int errno_(errno);
+	stall->epoch = handler::epoch;
+	if(const auto handler(handler::current); handler && handler->descriptor)
+		strlcpy(stall->descriptor, name(*handler->descriptor));
+
+	if(const auto context(ctx::current); context)
+	{
+		strlcpy(stall->context, name(*context));
+		stall->context_id = id(*context);
+	}
+
+	stall->frames = ::backtrace(stall->backtrace.data(), stall->backtrace.size());
+	traced.store(true, std::memory_order_release);
+	errno = errno_;
+}
+
 //
 // emption
 //
@@ -190,7 +779,10 @@ namespace ircd::ios::empt
 	extern const string_view freq_help;
 
 	[[gnu::visibility("internal")]]
-	extern uint64_t stats[9];
+	extern const string_view spin_help;
+
+	[[gnu::visibility("internal")]]
+	extern uint64_t stats[14];
 
 }
 
@@ -216,6 +808,26 @@ ircd::ios::empt::freq_help
 	the FPU in the core event loop's codepath.
 )"};
 
+decltype(ircd::ios::empt::spin_help)
+ircd::ios::empt::spin_help
+{R"(
+	Busy-poll budget in reference cycles. When non-zero, instead of blocking
+	for events the core event loop first spins on non-blocking polls to the
+	kernel for up to this many cycles, relaxing the core between polls, and
+	only then blocks. This trades a core for lower wakeup latency.
+
+	Spinning only occurs while the loop is loaded: the last poll which
+	reported events must meet spin_load. Levels are 1 for any events, then 2,
+	3, 4 and 5 for the low, medium, high and stall thresholds which also
+	count load_low through load_stall. Loading ends when a blocking poll
+	times out without events.
+
+	The spin_* statistics report the cycles spent spinning against the events
+	captured while spinning; spin_cycles / spin_events is the cost in cycles
+	of each event caught early. When spin_hits is small relative to
+	spin_count the budget is wasted and this should be disabled.
+)"};
+
 decltype(ircd::ios::empt::stats)
 ircd::ios::empt::stats;
 
@@ -328,6 +940,80 @@ uint64_t ircd::ios::empt::load_stall = 0;
 // 	}
 // };
 
+uint64_t ircd::ios::empt::spin = 0;
+// /// Busy-poll budget in cycles; zero disables.
+// decltype(ircd::ios::empt::spin)
+// ircd::ios::empt::spin
+// {
+// 	{ "name",      "ircd.ios.empt.spin" },
+// 	{ "default",   0L                   },
+// 	{ "help",      spin_help            },
+// };
+
+uint64_t ircd::ios::empt::spin_load = 1;
+// /// Minimum load level of the last poll to busy-poll.
+// decltype(ircd::ios::empt::spin_load)
+// ircd::ios::empt::spin_load
+// {
+// 	{ "name",      "ircd.ios.empt.spin.load" },
+// 	{ "default",   1L                        },
+// };
+
+uint64_t ircd::ios::empt::spin_count = 0;
+// /// Count of busy-poll episodes.
+// decltype(ircd::ios::empt::spin_count)
+// ircd::ios::empt::spin_count
+// {
+// 	stats + 9,
+// 	{
+// 		{ "name", "ircd.ios.empt.spin.count" },
+// 	},
+// };
+
+uint64_t ircd::ios::empt::spin_polls = 0;
+// /// Count of non-blocking calls made while busy-polling.
+// decltype(ircd::ios::empt::spin_polls)
+// ircd::ios::empt::spin_polls
+// {
+// 	stats + 10,
+// 	{
+// 		{ "name", "ircd.ios.empt.spin.polls" },
+// 	},
+// };
+
+uint64_t ircd::ios::empt::spin_cycles = 0;
+// /// Total reference cycles spent busy-polling.
+// decltype(ircd::ios::empt::spin_cycles)
+// ircd::ios::empt::spin_cycles
+// {
+// 	stats + 11,
+// 	{
+// 		{ "name", "ircd.ios.empt.spin.cycles" },
+// 	},
+// };
+
+uint64_t ircd::ios::empt::spin_hits = 0;
+// /// Count of episodes which captured events within the budget.
+// decltype(ircd::ios::empt::spin_hits)
+// ircd::ios::empt::spin_hits
+// {
+// 	stats + 12,
+// 	{
+// 		{ "name", "ircd.ios.empt.spin.hits" },
+// 	},
+// };
+
+uint64_t ircd::ios::empt::spin_events = 0;
+// /// Total events captured while busy-polling.
+// decltype(ircd::ios::empt::spin_events)
+// ircd::ios::empt::spin_events
+// {
+// 	stats + 13,
+// 	{
+// 		{ "name", "ircd.ios.empt.spin.events" },
+// 	},
+// };
+
 //
 // descriptor
 //
@@ -347,6 +1033,67 @@ ircd::util::instance_list<ircd::ios::descriptor>::list
 decltype(ircd::ios::descriptor::ids)
 ircd::ios::descriptor::ids;
 
+/// Defined after the descriptor list it registers in; see shard::run().
+decltype(ircd::ios::shard_fault_desc)
+ircd::ios::shard_fault_desc
+{
+	"ircd.ios.shard.fault"
+};
+
+namespace ircd::ios
+{
+	static allocator::slab_pool *handle_pool(const size_t &size) noexcept;
+}
+
+/// Handler storage in size classes; most handles are the size of a lambda
+/// capturing a few pointers wrapped by ios::handle.
+static ircd::allocator::slab_pool
+handle_pools[]
+{
+	{ "ircd.ios.handle.64",   64   },
+	{ "ircd.ios.handle.128",  128  },
+	{ "ircd.ios.handle.256",  256  },
+};
+
+ircd::allocator::slab_pool *
+ircd::ios::handle_pool(const size_t &size)
+noexcept
+{
+	for(auto &pool : handle_pools)
+		if(size <= pool.size)
+			return &pool;
+
+	return nullptr;
+}
+
+[[gnu::hot]]
+void
+ircd::ios::descriptor::default_deallocator(handler &handler,
+                                           void *const ptr,
+                                           const size_t size)
+noexcept
+{
+	if(auto *const pool(handle_pool(size)); likely(pool))
+		return pool->deallocate(ptr);
+
+	#ifdef __clang__
+		::operator delete(ptr);
+	#else
+		::operator delete(ptr, size);
+	#endif
+}
+
+[[gnu::hot]]
+void *
+ircd::ios::descriptor::default_allocator(handler &handler,
+                                         const size_t size)
+{
+	if(auto *const pool(handle_pool(size)); likely(pool))
+		return pool->allocate();
+
+	return ::operator new(size);
+}
+
 //
 // descriptor::descriptor
 //
@@ -630,6 +1377,7 @@ noexcept
 	#endif
 
 	handler::current = nullptr;
+	qsbr::quiescent();
 }
 
 [[gnu::hot]]
@@ -718,6 +1466,15 @@ ircd::ios::dispatch::dispatch(descriptor &descriptor,
 	boost::asio::post(get(), handle(descriptor, std::move(function)));
 }
 
+ircd::ios::dispatch::dispatch(shard &shard,
+                              descriptor &descriptor,
+                              defer_t,
+                              std::function<void ()> function)
+{
+	assert(shard.context);
+	boost::asio::post(*shard.context, handle(descriptor, std::move(function)));
+}
+
 ircd::ios::dispatch::dispatch(descriptor &descriptor,
                               yield_t,
                               const std::function<void ()> &function)
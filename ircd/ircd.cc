@@ -14,7 +14,10 @@ try
 		context::POST | context::SLICE_EXEMPT
 	};
     main_context.detach();
-    ctx::ole::init _ole_; 
+
+	// The offload engine stays up for the life of the process.
+	static ctx::ole::init _ole_;
+
     context user_context
 	{
 		"user",
@@ -193,4 +193,27 @@ ircd::util::iec(const uint64_t &value)
 	{
 		value, v, unit.at(pos)
 	};
-}
\ No newline at end of file
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// util/what.h
+//
+
+ircd::string_view
+ircd::util::what(const std::exception_ptr eptr)
+noexcept try
+{
+	if(likely(eptr))
+		std::rethrow_exception(eptr);
+
+	return {};
+}
+catch(const std::exception &e)
+{
+	return e.what();
+}
+catch(...)
+{
+	return "unknown exception";
+}
@@ -4,6 +4,15 @@
 #include<cstring>
 #include<memory>
 #include<limits>
+#include<vector>
+#include<random>
+#include<chrono>
+#include<algorithm>
+#include<list>
+#include<thread>
+#include<sstream>
+#include<mutex>
+#include<condition_variable>
 
 using namespace ircd::allocator;
 using namespace ircd::buffer;
@@ -112,6 +121,99 @@ void test_allocator_fixed() {
     cout<<"-----------test fixed end--------------------"<<endl;
 }
 
+// Threads allocate and mark objects and hand them over through a shared
+// list; whichever thread takes them checks the mark and frees them. When the
+// pool is exhausted a thread takes the list first.
+void test_allocator_concurrent() {
+    cout<<"-----------test concurrent start--------------------"<<endl;
+    constexpr size_t threads = 4, rounds = 2000, batch = 64;
+    using obj = std::array<size_t, 4>;
+    static concurrent<obj, 1024> pool;
+    auto ac = pool();
+    std::mutex mutex;
+    std::vector<obj *> handoff;
+    std::atomic<size_t> bad {0};
+    const auto take = [&] {
+        std::vector<obj *> theirs;
+        {
+            const std::lock_guard lock{mutex};
+            theirs.swap(handoff);
+        }
+        for(auto *const p : theirs) {
+            bad += (*p)[0] != (*p)[3] || (*p)[0] >= threads;
+            ac.deallocate(p, 1);
+        }
+    };
+    std::vector<std::thread> workers;
+    for(size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] {
+            for(size_t r = 0; r < rounds; ++r) {
+                std::vector<obj *> mine;
+                while(mine.size() < batch) {
+                    auto *const p = ac.allocate(std::nothrow, 1);
+                    if(!p) {
+                        take();
+                        continue;
+                    }
+                    p->fill(t);
+                    mine.emplace_back(p);
+                }
+                {
+                    const std::lock_guard lock{mutex};
+                    handoff.insert(handoff.end(), mine.begin(), mine.end());
+                }
+                if(r % 2)
+                    take();
+            }
+        });
+    for(auto &w : workers)
+        w.join();
+    take();
+
+    auto *const run = ac.allocate(8);
+    const auto used = pool.used();
+    ac.deallocate(run, 8);
+    cout<<"concurrent bad:"<<bad<<" run:"<<used<<" used:"<<pool.used()<<endl;
+    cout<<"-----------test concurrent end--------------------"<<endl;
+}
+
+void test_allocator_twolevel() {
+    cout<<"-----------test twolevel start--------------------"<<endl;
+    twolevel_site site{"test.twolevel"};
+    {
+        twolevel<int, 64> tl{site};
+        auto ac = tl();
+        std::vector<int *> ps;
+        for(int i = 0; i < 10; ++i)
+            ps.emplace_back(ac.allocate(1));
+        auto *const big = ac.allocate(100);
+        ac.deallocate(big, 100);
+        for(auto *const p : ps)
+            ac.deallocate(p, 1);
+    }
+    cout<<"twolevel hits:"<<site.hits<<" spills:"<<site.spills<<" peak:"<<site.peak<<" demand:"<<site.demand<<endl;
+
+    twolevel_site adaptive_site{"test.adaptive"};
+    for(int round = 0; round < 2; ++round) {
+        adaptive_twolevel<int> tl{adaptive_site};
+        auto ac = tl();
+        std::vector<int *> ps;
+        for(int i = 0; i < 300; ++i)
+            ps.emplace_back(ac.allocate(1));
+        for(auto *const p : ps)
+            ac.deallocate(p, 1);
+        cout<<"adaptive round:"<<round<<" l0:"<<adaptive_site.l0_size<<" hits:"<<adaptive_site.hits
+            <<" spills:"<<adaptive_site.spills<<" live:"<<tl.live[0] + tl.live[1]<<endl;
+    }
+    size_t sites = 0;
+    ircd::allocator::for_each([&sites](const twolevel_site &site) {
+        sites += site.name.substr(0, 5) == "test.";
+        return true;
+    });
+    cout<<"twolevel sites:"<<sites<<" default:"<<twolevel<long, 32>::default_site.name<<endl;
+    cout<<"-----------test twolevel end--------------------"<<endl;
+}
+
 void test_allocator_allocate() {
     cout<<"-----------test allocate start--------------------"<<endl;
     string s = "test_allocator";
@@ -126,12 +228,357 @@ void test_allocator_allocate() {
     cout<<"-----------test allocate end--------------------"<<endl;
 }
 
+struct slab_obj : slab_new<slab_obj> {
+    char data[48];
+};
+
+template<>
+slab_pool slab<slab_obj>::pool {"test.slab_obj", sizeof(slab_obj), alignof(slab_obj)};
+
+void test_allocator_slab() {
+    cout<<"-----------test slab start--------------------"<<endl;
+    std::vector<std::unique_ptr<slab_obj>> objs;
+    for(int i = 0; i < 100; ++i)
+        objs.emplace_back(new slab_obj);
+    const auto peak = slab<slab_obj>::pool.live.load();
+
+    // Free on another thread; its magazines go back to the depot at exit.
+    std::thread{[&objs] {
+        objs.resize(10);
+    }}.join();
+    for(int i = 0; i < 90; ++i)
+        objs.emplace_back(new slab_obj);
+
+    std::list<int, slab<int>> list;
+    for(int i = 0; i < 1000; ++i)
+        list.emplace_back(i);
+
+    const auto &pool(slab<slab_obj>::pool);
+    cout<<"slab live:"<<pool.live<<" peak:"<<pool.peak<<" expect:"<<peak<<" slabs:"<<pool.grows<<endl;
+    size_t pools = 0;
+    ircd::allocator::for_each([&pools](const slab_pool &pool) {
+        pools += pool.name == "test.slab_obj";
+        return true;
+    });
+    cout<<"slab list:"<<list.size()<<" back:"<<list.back()<<" registered:"<<pools<<endl;
+
+    // A pool destroyed while a thread which used it still runs; the thread
+    // then uses a new pool given the same id, and exits after both.
+    std::mutex mutex;
+    std::condition_variable cond;
+    int step = 0;
+    auto *const temp = new slab_pool{"test.slab_temp", 32};
+    std::thread thread{[&] {
+        temp->deallocate(temp->allocate());
+        std::unique_lock lock{mutex};
+        step = 1;
+        cond.notify_all();
+        cond.wait(lock, [&] { return step == 2; });
+    }};
+    {
+        std::unique_lock lock{mutex};
+        cond.wait(lock, [&] { return step == 1; });
+    }
+    const auto temp_id = temp->id;
+    delete temp;
+    slab_pool reused{"test.slab_reused", 32};
+    reused.deallocate(reused.allocate());
+    {
+        const std::lock_guard lock{mutex};
+        step = 2;
+        cond.notify_all();
+    }
+    thread.join();
+    cout<<"slab detached id reused:"<<(reused.id == temp_id)<<" live:"<<reused.live<<endl;
+    cout<<"-----------test slab end--------------------"<<endl;
+}
+
+void test_allocator_arena() {
+    cout<<"-----------test arena start--------------------"<<endl;
+    char stack[256];
+    arena a{stack};
+    std::vector<int, arena::allocator<int>> small(a);
+    small.assign(16, 1);
+    cout<<"arena inline:"<<(a.blocks == 0 && a.owns(small.data()))<<endl;
+
+    const arena::mark m{a};
+    {
+        std::vector<int, arena::allocator<int>> big(a);
+        for(int i = 0; i < 10000; ++i)
+            big.push_back(i);
+        cout<<"arena grown blocks:"<<a.blocks<<" back:"<<big.back()<<endl;
+    }
+    a.rewind(m);
+    cout<<"arena rewound blocks:"<<a.blocks<<" allocated:"<<a.allocated<<" small:"<<small[15]<<endl;
+
+    auto *const before = new std::string(100, 'y');
+    {
+        const arena::scope scope{a};
+        auto &cur(*ircd::allocator::scope::current);
+        auto *p = static_cast<char *>(cur.user_alloc(8));
+        std::strcpy(p, "arena");
+        p = static_cast<char *>(cur.user_realloc(p, 5000));
+        cout<<"arena scope:"<<p<<" owned:"<<a.owns(p)<<endl;
+        cur.user_free(p);
+
+        // Through the global operator new, as third-party code would.
+        auto *const str = new std::string(100, 'x');
+        std::vector<int> vec(1000, 1);
+        cout<<"arena scope new:"<<a.owns(str)<<" data:"<<a.owns(str->data())<<" vector:"<<a.owns(vec.data())<<endl;
+        delete str;
+
+        // Spans several blocks; each is found from its tag.
+        std::vector<void *> made;
+        for(int i = 0; i < 4096; ++i)
+            made.push_back(::operator new(24));
+        size_t tagged = 0;
+        for(const auto *const p : made)
+            tagged += arena::scope::owns(a, p);
+        cout<<"arena scope tagged:"<<tagged<<"/"<<made.size()<<" foreign:"<<arena::scope::owns(a, before)<<endl;
+        delete before;
+    }
+    std::vector<int> heap(1000, 1);
+    cout<<"arena scope ended:"<<!a.owns(heap.data())<<endl;
+    a.reset();
+    cout<<"arena reset blocks:"<<a.blocks<<" allocated:"<<a.allocated<<endl;
+    cout<<"-----------test arena end--------------------"<<endl;
+}
+
+void test_allocator_hugepage() {
+    cout<<"-----------test hugepage start--------------------"<<endl;
+    namespace hugepage = ircd::allocator::hugepage;
+    const size_t huge = hugepage::size?: 2UL << 20;
+    auto a = hugepage::allocate(100000), b = hugepage::allocate(100000);
+    auto big = hugepage::allocate(huge * 2);
+    std::memset(data(big), 1, size(big));
+    std::memset(data(a), 1, size(a));
+    cout<<"hugepage slot:"<<size(a)<<" adjacent:"<<(data(b) + size(b) == data(a) || data(a) + size(a) == data(b))
+        <<" big aligned:"<<(uintptr_t(data(big)) % huge == 0)<<" size:"<<size(big) / huge<<endl;
+    cout<<"hugepage requested:"<<hugepage::requested<<" padded:"<<hugepage::padded<<" mapped:"<<hugepage::mapped
+        <<" backed<=mapped:"<<(hugepage::backed() <= hugepage::mapped)<<endl;
+    hugepage::deallocate(big);
+    hugepage::deallocate(b);
+    auto c = hugepage::allocate(100000);
+    cout<<"hugepage reuse:"<<(data(c) == data(b))<<" mapped:"<<hugepage::mapped / huge<<endl;
+    hugepage::deallocate(a);
+    hugepage::deallocate(c);
+    cout<<"hugepage requested:"<<hugepage::requested<<" padded:"<<hugepage::padded<<endl;
+
+    // Just under half a huge page pads to half and takes its own region, as
+    // its free must; freeing one leaves the other mapped.
+    auto d = hugepage::allocate(huge / 2 - 100), e = hugepage::allocate(huge / 2 - 100);
+    std::memset(data(d), 1, size(d));
+    hugepage::deallocate(d);
+    std::memset(data(e), 2, size(e));
+    cout<<"hugepage boundary size:"<<size(e) / huge<<" mapped:"<<hugepage::mapped / huge<<" kept:"<<int(data(e)[0])<<endl;
+    hugepage::deallocate(e);
+    cout<<"-----------test hugepage end--------------------"<<endl;
+}
+
+void test_allocator_je() {
+    cout<<"-----------test je start--------------------"<<endl;
+    namespace je = ircd::allocator::je;
+    size_t arenas = 0;
+    je::for_each([&arenas](const je::arena &a) {
+        ++arenas;
+        return true;
+    });
+    std::vector<int, je::arena::allocator<int>> v(je::arena::cache);
+    for(int i = 0; i < 1000; ++i)
+        v.push_back(i);
+    {
+        const je::arena::scope scope{je::arena::io_buffer};
+        std::unique_ptr<char[]> buf(new char[4096]);
+    }
+    const auto stats = je::arena::cache.stats();
+    cout<<"je available:"<<je::available<<" arenas:"<<arenas<<" back:"<<v.back()
+        <<" stats:"<<(je::available? stats.allocated >= v.size() * sizeof(int): stats.allocated == 0)<<endl;
+    cout<<"-----------test je end--------------------"<<endl;
+}
+
+void test_allocator_pressure() {
+    cout<<"-----------test pressure start--------------------"<<endl;
+    namespace pressure = ircd::allocator::pressure;
+    size_t wanted = 0;
+    pressure::evictor evictor{"test.evictor", [&wanted](const size_t &want) {
+        wanted += want;
+        return want;
+    }};
+    const auto usage = pressure::read().usage;
+    string states;
+    for(const double ratio : {1.0, 0.85, 0.5, 0.85, 1.0}) {
+        pressure::limit = usage / ratio;
+        states += std::to_string(int(pressure::check()));
+    }
+    cout<<"pressure usage:"<<(usage > 0)<<" states:"<<states<<" episodes:"<<pressure::episodes
+        <<" calls:"<<evictor.calls<<" wanted:"<<(wanted > 0)<<endl;
+    pressure::interval = std::chrono::milliseconds(1);
+    const auto reclaims = pressure::reclaims.load();
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    pressure::start();
+    while(pressure::reclaims < reclaims + 3 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+    pressure::stop();
+    pressure::limit = 0;
+    cout<<"pressure thread reclaimed:"<<(pressure::reclaims >= reclaims + 3)<<" running:"<<pressure::running()<<endl;
+    cout<<"-----------test pressure end--------------------"<<endl;
+}
+
+void test_allocator_sampler() {
+    cout<<"-----------test sampler start--------------------"<<endl;
+    namespace sampler = ircd::allocator::sampler;
+    const auto count = [](const sampler::snapshot &snap) {
+        size_t ret = 0;
+        for(const auto &site : snap.sites)
+            ret += site.count;
+        return ret;
+    };
+    std::vector<std::unique_ptr<std::array<char, 1024>>> held;
+    held.reserve(256);
+    sampler::rate = 4096;
+    const auto base = sampler::snap();
+    for(int i = 0; i < 256; ++i)
+        held.emplace_back(new std::array<char, 1024>);
+    asm volatile ("" :: "r"(held.data()) : "memory");
+    const auto leaks = sampler::snap(&base);
+    held.resize(128);
+    const auto grew = sampler::diff(sampler::snap(), base);
+    bool pprof, maps;
+    {
+        std::stringstream out;
+        sampler::dump(out, grew);
+        const auto text = out.str();
+        pprof = text.rfind("heap profile: ", 0) == 0 && text.find("@ heap_v2/4096\n") != text.npos;
+        maps = text.find("MAPPED_LIBRARIES:") != text.npos;
+    }
+    const auto leaked = count(leaks), grown = count(grew);
+    held.clear();
+    const auto after = sampler::snap(&base);
+    sampler::rate = 0;
+    cout<<"sampler leaks:"<<(leaked > 16)<<" grew:"<<(grown > 0 && grown < leaked)
+        <<" pprof:"<<pprof<<" maps:"<<maps<<" after:"<<count(after)<<endl;
+    cout<<"-----------test sampler end--------------------"<<endl;
+}
+
+// The bit-at-a-time search which state::next() replaced; used as the
+// reference for results and speed.
+uint next_bitwise(const state &st, const size_t &n) {
+    uint ret(st.last), rem(n);
+    for(; ret < st.size && rem; ++ret)
+        rem = st.test(ret)? n: rem - 1;
+    if(!rem)
+        return ret - n;
+    for(ret = 0, rem = n; ret < st.last && rem; ++ret)
+        rem = st.test(ret)? n: rem - 1;
+    return rem? st.size: ret - n;
+}
+
+void bench_allocator_state() {
+    cout<<"-----------bench state start--------------------"<<endl;
+    constexpr size_t slots = 4096, ops = 20000;
+    std::vector<state::word_t> buf(slots / state::word_bits);
+    std::mt19937_64 rng(0);
+    for(const size_t fill : {0, 50, 90}) {
+        for(const size_t run : {1, 8, 64}) {
+            std::fill(buf.begin(), buf.end(), 0);
+            state st(slots, buf.data());
+            while(st.used() < slots * fill / 100)
+                st.bts(rng() % slots);
+
+            std::vector<uint> lasts(ops);
+            for(auto &last : lasts)
+                last = rng() % slots;
+
+            bool same = true;
+            for(const auto &last : lasts) {
+                st.last = last;
+                same &= st.next(run) == next_bitwise(st, run);
+            }
+
+            size_t found = 0;
+            const auto start = std::chrono::steady_clock::now();
+            for(const auto &last : lasts) {
+                st.last = last;
+                const auto pos = st.allocate(std::nothrow, run);
+                if(pos < slots) {
+                    st.deallocate(pos, run);
+                    ++found;
+                }
+            }
+            const auto word_time = std::chrono::steady_clock::now() - start;
+
+            const auto start_bit = std::chrono::steady_clock::now();
+            for(const auto &last : lasts) {
+                st.last = last;
+                const auto pos = next_bitwise(st, run);
+                if(pos < slots) {
+                    for(size_t j = 0; j < run; ++j)
+                        st.bts(pos + j);
+                    for(size_t j = 0; j < run; ++j)
+                        st.btc(pos + j);
+                }
+            }
+            const auto bit_time = std::chrono::steady_clock::now() - start_bit;
+
+            using std::chrono::nanoseconds;
+            cout<<"state fill:"<<fill<<"% run:"<<run<<" found:"<<found
+                <<" ns/op word:"<<std::chrono::duration_cast<nanoseconds>(word_time).count() / ops
+                <<" bit:"<<std::chrono::duration_cast<nanoseconds>(bit_time).count() / ops
+                <<" same:"<<same<<endl;
+        }
+    }
+    cout<<"-----------bench state end--------------------"<<endl;
+}
+
+void bench_allocator_concurrent() {
+    cout<<"-----------bench concurrent start--------------------"<<endl;
+    constexpr size_t ops = 200000;
+    using obj = std::array<char, 64>;
+    static concurrent<obj, 4096> pool;
+    for(const size_t threads : {1, 4}) {
+        const auto run = [&threads](auto &&alloc, auto &&free) {
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> workers;
+            for(size_t t = 0; t < threads; ++t)
+                workers.emplace_back([&alloc, &free] {
+                    std::array<obj *, 16> held;
+                    for(size_t i = 0; i < ops / held.size(); ++i) {
+                        for(auto &p : held)
+                            p = alloc();
+                        asm volatile ("" :: "r"(held.data()) : "memory");
+                        for(auto &p : held)
+                            free(p);
+                    }
+                });
+            for(auto &w : workers)
+                w.join();
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / ops;
+        };
+        auto ac = pool();
+        const auto ours = run([&ac] { return ac.allocate(1); }, [&ac](obj *p) { ac.deallocate(p, 1); });
+        const auto heap = run([] { return new obj; }, [](obj *p) { delete p; });
+        cout<<"concurrent threads:"<<threads<<" ns/op concurrent:"<<ours<<" new:"<<heap
+            <<" used:"<<pool.used()<<endl;
+    }
+    cout<<"-----------bench concurrent end--------------------"<<endl;
+}
 
 int main(){
     test_allocator_callback();
     test_allocator_state();
     test_allocator_dynamic();
     test_allocator_fixed();
+    test_allocator_concurrent();
+    test_allocator_twolevel();
     test_allocator_allocate();
+    test_allocator_slab();
+    test_allocator_arena();
+    test_allocator_hugepage();
+    test_allocator_je();
+    test_allocator_pressure();
+    test_allocator_sampler();
+    bench_allocator_state();
+    bench_allocator_concurrent();
     return 0;
 }
\ No newline at end of file
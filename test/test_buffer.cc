@@ -4,6 +4,9 @@
 #include <tuple>
 #include <functional>
 #include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <sys/uio.h>
 
 using namespace ircd::buffer;
 using std::cout;
@@ -50,8 +53,84 @@ void test_buffer_base() {
     cout<<"-----------------------test buffer fixed_buffer end---------------------"<<endl;
 }
 
+static string flat(const ircd::vector_view<const const_buffer> &bufs) {
+    string ret(buffers::size(bufs), '\0');
+    buffers::copy(mutable_buffer{ret.data(), ret.size()}, bufs);
+    return ret;
+}
+
+void test_iov() {
+    char a[] = "world", b[] = "hello ", c[] = "big ";
+    ircd::iov<4> list {const_buffer{a, 5}};
+    list.prefix(const_buffer{b, 6});
+    const const_buffer mid[] {const_buffer{c, 4}, const_buffer{}};
+    list.splice(3, mid);
+    cout<<"iov flat:"<<flat(list)<<" size:"<<list.size()<<" bytes:"<<list.bytes()<<endl;
+
+    const ircd::iov<4>::as<struct ::iovec> vec {list};
+    string joined;
+    for(const auto &v : vec)
+        joined.append(static_cast<const char *>(v.iov_base), v.iov_len);
+
+    const auto took(list.consume(9));
+    cout<<"iov iovec:"<<joined<<" consumed:"<<took<<" rest:"<<flat(list)<<" size:"<<list.size()<<endl;
+
+    bool thrown = false;
+    try {
+        list.append(const_buffer{a, 1}).append(const_buffer{a, 2}).append(const_buffer{a, 3});
+    } catch(const std::out_of_range &) {
+        thrown = true;
+    }
+    cout<<"iov full:"<<thrown<<" size:"<<list.size()<<endl;
+}
+
+void test_rc_buffer() {
+    namespace rc = ircd::buffer::rc;
+    const auto allocs0 = rc::stats.allocs.load();
+    rc_mutable_buffer msg(600);
+    copy(mutable_buffer(msg), const_buffer{"fanout", 6});
+    {
+        const rc_const_buffer ro(msg);
+        vector<rc_const_buffer> clients(1000, ro);
+        cout<<"rc fanout:"<<string(data(clients.back()), 6)<<" refs:"<<msg.use_count()
+            <<" allocs:"<<rc::stats.allocs.load() - allocs0<<endl;
+    }
+    const auto reuses0 = rc::stats.reuses.load();
+    const size_t refs = msg.use_count();
+    msg = {};
+    msg = rc_mutable_buffer(1000);
+    const rc_buffer<const_buffer, true> shared(const_buffer{"shared", 6});
+    rc_buffer<const_buffer, true> other;
+    std::thread([&other, copy = shared] { other = copy; }).join();
+    cout<<"rc refs:"<<refs<<" reuse:"<<rc::stats.reuses.load() - reuses0<<" atomic:"<<shared.use_count()
+        <<" "<<string(data(other), size(other))<<endl;
+    { const rc_const_buffer big(rc::class_max), small(2000); }
+    cout<<"rc outsized:"<<(rc::stats.outsized.load() > 0)<<" trim:"<<rc::trim()<<endl;
+
+    // Blocks freed on another thread come back through the depot.
+    vector<rc_mutable_buffer> many;
+    for(int i = 0; i < 1000; ++i)
+        many.emplace_back(600);
+    std::thread([&many] { many.clear(); }).join();
+    const auto depot0 = rc::stats.depot.load();
+    const auto reuses1 = rc::stats.reuses.load();
+    for(int i = 0; i < 1000; ++i)
+        many.emplace_back(600);
+    size_t evictors = 0;
+    ircd::allocator::pressure::for_each([&evictors](const auto &evictor) {
+        evictors += evictor.name == "ircd.buffer.rc";
+        return true;
+    });
+    cout<<"rc depot refills:"<<(rc::stats.depot.load() > depot0)
+        <<" reused:"<<rc::stats.reuses.load() - reuses1<<" evictor:"<<evictors<<endl;
+    many.clear();
+    cout<<"rc trimmed:"<<(rc::trim() > 0)<<endl;
+}
+
 int main() {
     test_buffer_base();
+    test_iov();
+    test_rc_buffer();
     return 0;
 }
 
@@ -1,5 +1,15 @@
 #include<iostream>
 #include<string>
+#include<vector>
+#include<functional>
+#include<atomic>
+#include<thread>
+#include<memory>
+#include<mutex>
+#include<set>
+#include<fstream>
+#include<filesystem>
+#include<fcntl.h>
 
 using std::cout;
 using std::endl;
@@ -36,10 +46,433 @@ void printStr(string s){
     cout<<"hello "<<s<<endl;
 }
 
+ircd::ios::descriptor test_batch_desc {
+    "test.ctx.dispatch_batch"
+};
+
+int batch_count = 0;
+
+void test_dispatch_batch() {
+    std::vector<std::function<void ()>> batch;
+    for(int i=0; i<8; i++) {
+        batch.emplace_back([] {
+            ++batch_count;
+        });
+    }
+    ircd::ios::dispatch_batch{test_batch_desc, ircd::ios::defer, std::move(batch)};
+    ircd::ios::dispatch{test_batch_desc, ircd::ios::defer, ircd::ios::typed, [] {
+        cout<<"dispatch_batch count:"<<batch_count<<" calls:"<<test_batch_desc.stats->calls<<endl;
+    }};
+}
+
+ircd::ios::descriptor test_shard_desc {
+    "test.ctx.shard"
+};
+
+std::atomic<int> shard_count {0};
+
+void test_shard(boost::asio::io_context &io_context) {
+    ircd::ios::shard::opts opts;
+    opts.count = 2;
+    ircd::ios::shard::start(opts);
+    for(auto &shard : ircd::ios::shard::list) {
+        ircd::ios::dispatch{*shard, test_shard_desc, ircd::ios::defer, [] {
+            ircd::context ctx {
+                "shard", [] {
+                    ++shard_count;
+                },
+                ircd::context::DETACH
+            };
+        }};
+    }
+    while(shard_count < int(ircd::ios::shards()))
+        std::this_thread::yield();
+
+    cout<<"shards:"<<ircd::ios::shards()<<" contexts run:"<<shard_count<<endl;
+
+    auto &shard(*ircd::ios::shard::list.front());
+    ircd::ios::dispatch{shard, test_shard_desc, ircd::ios::defer, [] {
+        throw std::runtime_error("shard fault");
+    }};
+    while(!shard.faults)
+        std::this_thread::yield();
+
+    string rethrown;
+    io_context.restart();
+    try {
+        io_context.run();
+    } catch(const std::exception &e) {
+        rethrown = e.what();
+    }
+    cout<<"shard faults:"<<shard.faults<<" rethrown:"<<rethrown<<endl;
+    ircd::ios::shard::stop();
+}
+
+ircd::ios::descriptor test_stall_desc {
+    "test.ctx.stall"
+};
+
+void test_watchdog() {
+    ircd::ios::watchdog::interval = std::chrono::milliseconds(10);
+    ircd::ios::watchdog::threshold = std::chrono::milliseconds(50);
+    ircd::ios::watchdog::start();
+    ircd::ios::dispatch{test_stall_desc, ircd::ios::defer, [] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }};
+    ircd::ios::dispatch{test_batch_desc, ircd::ios::defer, [] {
+        ircd::ios::watchdog::stop();
+        ircd::ios::watchdog::for_each([](const auto &stall) {
+            cout<<"watchdog stalls:"<<ircd::ios::watchdog::stalls
+                <<" descriptor:"<<stall.descriptor
+                <<" traced:"<<(stall.frames > 0)<<endl;
+            return false;
+        });
+    }};
+}
+
+ircd::ios::qsbr::ptr<string> test_config {
+    std::make_unique<string>("v0")
+};
+
+void test_qsbr() {
+    ircd::ios::dispatch{test_batch_desc, ircd::ios::defer, [] {
+        test_config.reset(std::make_unique<string>("v1"));
+        // The old object stays valid after reset() until the handler leaves.
+        const string *const old = test_config.get();
+        const auto reclaimed = ircd::ios::qsbr::reclaimed;
+        test_config.reset(std::make_unique<string>("v2"));
+        cout<<"qsbr held:"<<*old<<" reclaimed:"<<ircd::ios::qsbr::reclaimed - reclaimed<<endl;
+    }};
+    ircd::ios::dispatch{test_batch_desc, ircd::ios::defer, [] {
+        ircd::ios::qsbr::reclaim();
+        cout<<"qsbr retired:"<<ircd::ios::qsbr::retired
+            <<" reclaimed:"<<ircd::ios::qsbr::reclaimed
+            <<" value:"<<*test_config<<endl;
+    }};
+}
+
+void test_busy_poll(boost::asio::io_context &io_context) {
+    namespace empt = ircd::ios::empt;
+    empt::spin = 1UL << 32;
+    empt::spin_load = 0;
+    auto timer = std::make_shared<boost::asio::steady_timer>(io_context);
+    timer->expires_after(std::chrono::milliseconds(5));
+    timer->async_wait([timer](const auto &) {
+        empt::spin = 0;
+        empt::spin_load = 1;
+        cout<<"busy-poll spun:"<<(empt::spin_count > 0)
+            <<" hits:"<<(empt::spin_hits > 0)
+            <<" events/cycles:"<<(empt::spin_events > 0 && empt::spin_cycles > 0)<<endl;
+    });
+}
+
+// The spin budget far exceeds the timeout; the spin must end with it.
+void test_epoll_spin() {
+#if defined(BOOST_ASIO_HAS_EPOLL)
+    namespace empt = ircd::ios::empt;
+    const auto spin = empt::spin;
+    empt::spin = 1UL << 40;
+    const int epfd = ::epoll_create1(0);
+    struct ::epoll_event events[8];
+    int timeout = 5;
+    const auto start = std::chrono::steady_clock::now();
+    const int ret = ircd::ios::epoll_spin<__real_epoll_wait>(epfd, events, 8, timeout);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ::close(epfd);
+    empt::spin = spin;
+    cout<<"epoll spin ret:"<<ret<<" capped:"<<(elapsed < std::chrono::milliseconds(50))<<" timeout left:"<<timeout<<endl;
+#endif
+}
+
+// Offloads per second from 32 concurrent contexts at each worker count;
+// workers left from before are retired first, then the count is brought up
+// by offloads which wait for each other. Each measured offload does a fixed
+// amount of work so the workers rather than the loop are the bottleneck,
+// with 32 in flight; the rate is given against the workers which ran them.
+void bench_ole() {
+    namespace ole = ircd::ctx::ole;
+    const size_t contexts = 32, offloads = 64, work = 20000;
+    for(size_t workers = 1; workers <= 32; workers *= 2) {
+        ole::thread_max = workers;
+        ole::retire();
+        while(ole::workers() > workers)
+            std::this_thread::yield();
+
+        std::atomic<size_t> arrived {0};
+        std::vector<ircd::context> ctxs;
+        for(size_t i = 0; i < workers; ++i)
+            ctxs.emplace_back("bench", [&arrived, workers] {
+                ircd::ctx::offload{[&arrived, workers] {
+                    const auto until = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+                    for(++arrived; arrived < workers && std::chrono::steady_clock::now() < until;)
+                        std::this_thread::yield();
+                }};
+            });
+        for(auto &ctx : ctxs)
+            ctx.join();
+        ctxs.clear();
+
+        std::mutex mutex;
+        std::set<std::thread::id> ran;
+        const auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < contexts; ++i)
+            ctxs.emplace_back("bench", [&mutex, &ran] {
+                for(size_t j = 0; j < offloads; ++j)
+                    ircd::ctx::offload{[&mutex, &ran] {
+                        for(volatile size_t k = 0; k < work; ++k);
+                        const std::lock_guard lock{mutex};
+                        ran.emplace(std::this_thread::get_id());
+                    }};
+            });
+        for(auto &ctx : ctxs)
+            ctx.join();
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+        const auto rate = size_t(contexts * offloads / elapsed.count());
+        cout<<"ole bench workers:"<<workers<<" ran:"<<ran.size()<<" cores:"<<std::thread::hardware_concurrency()
+            <<" offloads/s:"<<rate<<" per worker:"<<rate / std::max(ran.size(), 1UL)<<endl;
+    }
+
+    size_t named = 0;
+    for(const auto &task : std::filesystem::directory_iterator("/proc/self/task")) {
+        std::ifstream comm(task.path() / "comm");
+        string name;
+        std::getline(comm, name);
+        named += name.substr(0, 4) == "ole ";
+    }
+    cout<<"ole named workers:"<<(named > 0)<<endl;
+
+    cout<<"ole completions drains:"<<(ole::drain_count > 0)
+        <<" per drain:"<<(ole::drain_total >= ole::drain_count)
+        <<" max:"<<ole::drain_max<<endl;
+}
+
+// With one worker held busy, a high priority offload queued behind several
+// low priority ones is run first.
+void test_ole_prio() {
+    ircd::ctx::ole::thread_max = 1;
+    std::mutex mutex;
+    std::vector<int> order;
+    std::vector<ircd::context> ctxs;
+    auto record = [&mutex, &order](const int &prio) {
+        const std::lock_guard lock{mutex};
+        order.emplace_back(prio);
+    };
+    ctxs.emplace_back("blocker", [] {
+        ircd::ctx::offload{[] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }};
+    });
+    for(const int prio : {10, 10, 10, 10, -10}) {
+        ctxs.emplace_back("prio", [prio, &record] {
+            ircd::ctx::ole::opts opts;
+            opts.name = prio < 0? "test.ole.high": "test.ole.low";
+            opts.prio = prio;
+            ircd::ctx::offload{opts, [prio, &record] {
+                record(prio);
+            }};
+        });
+    }
+    for(auto &ctx : ctxs)
+        ctx.join();
+
+    cout<<"ole prio first:"<<order.front()<<endl;
+    ircd::ctx::ole::for_each([](const auto &name, const auto &stats) {
+        if(name.substr(0, 8) == "test.ole")
+            cout<<"ole stats "<<name<<" count:"<<stats.count<<" queued:"<<stats.queued<<" max:"<<stats.queued_max<<endl;
+        return true;
+    });
+}
+
+// Many offloads in flight from one context, collected with when_all.
+void test_ole_async() {
+    std::vector<ircd::ctx::future<int>> futures;
+    for(int i = 0; i < 16; ++i)
+        futures.emplace_back(ircd::ctx::ole::async([i] {
+            return i * 2;
+        }));
+
+    ircd::ctx::when_all(begin(futures), end(futures)).wait();
+    int sum = 0;
+    for(auto &future : futures)
+        sum += future.get();
+
+    bool thrown = false;
+    auto failed = ircd::ctx::ole::async([] {
+        throw std::runtime_error("ole async");
+    });
+    try {
+        failed.wait();
+    } catch(const std::runtime_error &) {
+        thrown = true;
+    }
+    ircd::ctx::ole::opts opts;
+    opts.concurrency = 4;
+    std::atomic<int> runs {0};
+    const int once = ircd::ctx::ole::async(opts, [&runs] {
+        return ++runs;
+    }).get();
+    cout<<"ole async sum:"<<sum<<" thrown:"<<thrown<<" runs:"<<once<<endl;
+}
+
+std::vector<uint8_t> unhex(const string &hex) {
+    std::vector<uint8_t> ret;
+    for(size_t i = 0; i + 1 < hex.size(); i += 2)
+        ret.emplace_back(std::stoi(hex.substr(i, 2), nullptr, 16));
+    return ret;
+}
+
+void test_batch() {
+    namespace batch = ircd::batch;
+    const string abc {"abc"};
+    std::vector<ircd::const_buffer> in(1000, ircd::const_buffer{abc.data(), abc.size()});
+    std::vector<batch::sha256_buf> digest(in.size());
+    batch::sha256({digest.data(), digest.size()}, {in.data(), in.size()});
+    bool same = true;
+    for(const auto &d : digest)
+        same &= d == digest.front();
+    printf("batch sha256:%02x%02x%02x%02x same:%d\n", digest[0][0], digest[0][1], digest[0][2], digest[0][3], same);
+
+    // RFC 8032 7.1 test 1
+    auto pk = unhex("d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a");
+    auto sig = unhex("e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e065224901555fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b");
+    auto bad = sig;
+    bad[0] ^= 1;
+    const ircd::const_buffer msgs[2] {{abc.data(), 0UL}, {abc.data(), 0UL}};
+    const ircd::const_buffer sigs[2] {{(const char *)sig.data(), sig.size()}, {(const char *)bad.data(), bad.size()}};
+    const ircd::const_buffer pks[2] {{(const char *)pk.data(), pk.size()}, {(const char *)pk.data(), pk.size()}};
+    bool ok[2] {false, true};
+    batch::verify(ircd::vector_view<bool>(ok, 2UL), {msgs, 2UL}, {sigs, 2UL}, {pks, 2UL});
+    cout<<"batch verify good:"<<ok[0]<<" bad:"<<ok[1]<<endl;
+
+    char out[64];
+    ircd::mutable_buffer outs[1] {{out, sizeof(out)}};
+    if(batch::compress({outs, 1UL}, {in.data(), 1UL}, batch::codec::ZSTD))
+        cout<<"batch compress:"<<(size(outs[0]) > 0)<<endl;
+    else
+        cout<<"batch compress:unsupported"<<endl;
+}
+
+void test_fs() {
+    namespace fs = ircd::fs;
+    const string path {(std::filesystem::temp_directory_path() / "ircd_test_fs").string()};
+    const string text {"hello fs"};
+    {
+        fs::fd fd {path, O_CREAT | O_TRUNC | O_RDWR};
+        fs::fallocate(fd, 0, 4096);
+        fs::write(fd, {text.data(), text.size()});
+        fs::fsync(fd, false);
+        char buf[2];
+        const auto got = fs::pread(fd, {buf, sizeof(buf)}, 6);
+        cout<<"fs pread:"<<string(data(got), size(got))<<" size:"<<std::filesystem::file_size(path)<<endl;
+        const ircd::const_buffer parts[] {{text.data(), 6}, {}, {text.data() + 6, 2}, {"!", 1}};
+        const auto wrote = fs::write(fd, parts);
+        char all[9];
+        const auto back = fs::pread(fd, {all, sizeof(all)}, 8);
+        cout<<"fs gather:"<<wrote<<" "<<string(data(back), size(back))<<endl;
+        fs::fd &same = fd;
+        fd = std::move(same);
+        fs::fd moved {path, O_RDONLY};
+        moved = std::move(fd);
+        const auto kept = fs::pread(moved, {buf, sizeof(buf)}, 0);
+        cout<<"fs self-move kept:"<<string(data(kept), size(kept))<<" moved from:"<<!fd<<endl;
+    }
+    bool thrown = false;
+    try {
+        const string none {path + ".none"};
+        fs::fd fd {none, O_RDONLY};
+    } catch(const std::system_error &e) {
+        thrown = e.code().value() == ENOENT;
+    }
+    std::filesystem::remove(path);
+    const auto &reads = fs::opstats(fs::op::READ);
+    const auto &opens = fs::opstats(fs::op::OPEN);
+    cout<<"fs reads:"<<reads.count<<" bytes:"<<reads.bytes<<" open errors:"<<opens.errors<<" thrown:"<<thrown<<endl;
+}
+
+// Allocations in a context are charged to its name.
+void test_attribution() {
+    namespace attribution = ircd::allocator::attribution;
+    attribution::enable = true;
+    ircd::context ctx {
+        "test.alloc", [] {
+            std::vector<std::unique_ptr<std::array<char, 100>>> v;
+            for(int i = 0; i < 10; ++i)
+                v.emplace_back(new std::array<char, 100>);
+            asm volatile ("" :: "r"(v.data()) : "memory");
+        },
+        ircd::context::DETACH
+    };
+    ircd::ios::dispatch{test_batch_desc, ircd::ios::defer, [] {
+        attribution::enable = false;
+        attribution::for_each([](const auto &entry) {
+            if(ircd::string_view{entry.name} == "test.alloc")
+                cout<<"attribution "<<entry.name<<" count:"<<entry.count<<" bytes:"<<entry.bytes<<endl;
+            return true;
+        });
+    }};
+}
+
+// Idle pool contexts are ended by shrink() and removed on the next call.
+void test_pool_shrink() {
+    ircd::ctx::pool pool{"test.pool"};
+    pool.add(4);
+    ircd::ctx::this_ctx::yield();
+    const auto asked = pool.shrink(1);
+    for(int i = 0; i < 4; ++i)
+        ircd::ctx::this_ctx::yield();
+    const auto again = pool.shrink(1);
+    cout<<"pool shrink:"<<asked<<" again:"<<again<<" size:"<<pool.size()<<" running:"<<pool.running<<endl;
+}
+
+void test_ole() {
+    ircd::context ctx {
+        "ole", [] {
+            test_ole_prio();
+            test_ole_async();
+            test_batch();
+            test_fs();
+            test_pool_shrink();
+            std::atomic<size_t> ranks {0};
+            std::atomic<size_t> calls {0};
+            ircd::ctx::ole::opts opts;
+            opts.concurrency = 4;
+            ircd::ctx::ole::thread_max = 4;
+            ircd::ctx::offload{opts, [&ranks, &calls](const size_t &rank) {
+                ranks += rank;
+                ++calls;
+            }};
+            bool thrown = false;
+            try {
+                ircd::ctx::offload{opts, [] {
+                    throw std::runtime_error("ole");
+                }};
+            } catch(const std::runtime_error &) {
+                thrown = true;
+            }
+            cout<<"ole calls:"<<calls<<" ranks:"<<ranks<<" thrown:"<<thrown<<endl;
+            bench_ole();
+        },
+        ircd::context::DETACH
+    };
+}
+
 void test_ctx() {
     boost::asio::io_context io_context;
     ircd::init(io_context.get_executor());
+    test_dispatch_batch();
+    test_watchdog();
+    test_qsbr();
+    test_attribution();
+    test_busy_poll(io_context);
+    test_epoll_spin();
+    test_ole();
     io_context.run();
+    ircd::allocator::for_each([](const ircd::allocator::slab_pool &pool) {
+        if(pool.name == "ircd.ctx.ctx" || pool.name == "ircd.ctx.ole.job")
+            cout<<"slab "<<pool.name<<" live:"<<pool.live<<" used:"<<(pool.peak > 0)<<endl;
+        return true;
+    });
+    test_shard(io_context);
     cout<<"main thread id:"<<ircd::ios::main_thread_id<<" is main thread: "<<ircd::ios::is_main_thread<<endl;
 }
 